@@ -0,0 +1,594 @@
+#include "apu.h"
+#include <cmath>
+
+// https://gbdev.io/pandocs/Audio_Registers.html
+// https://gbdev.gg8.se/wiki/articles/Gameboy_sound_hardware
+
+const u32 CLOCK_RATE = 4194304;  // T-cycles per second
+const u32 FS_PERIOD = 8192;      // Frame sequencer runs at 512 Hz
+const int MIX_SCALE = 64;        // Full mix (4 channels * 15 * 8) stays inside 16 bits
+
+// Register offsets from 0xFF10
+enum {
+    NR10 = 0x00, NR11, NR12, NR13, NR14,
+    NR21 = 0x06, NR22, NR23, NR24,
+    NR30 = 0x0A, NR31, NR32, NR33, NR34,
+    NR41 = 0x10, NR42, NR43, NR44,
+    NR50 = 0x14, NR51, NR52,
+    WAVE_RAM = 0x20
+};
+
+// Bits that always read back as 1
+const u8 read_mask[0x30] = {
+    0x80, 0x3F, 0x00, 0xFF, 0xBF, // NR10-NR14
+    0xFF, 0x3F, 0x00, 0xFF, 0xBF, // NR20-NR24
+    0x7F, 0xFF, 0x9F, 0xFF, 0xBF, // NR30-NR34
+    0xFF, 0xFF, 0x00, 0x00, 0xBF, // NR40-NR44
+    0x00, 0x00, 0x70,             // NR50-NR52
+    0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, // Unused
+    0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,       // Wave RAM
+    0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00
+};
+
+const u8 duty_table[4][8] = {
+    {0, 0, 0, 0, 0, 0, 0, 1}, // 12.5%
+    {1, 0, 0, 0, 0, 0, 0, 1}, // 25%
+    {1, 0, 0, 0, 0, 1, 1, 1}, // 50%
+    {0, 1, 1, 1, 1, 1, 1, 0}  // 75%
+};
+
+// One noise clock: 15-bit LFSR, or 7-bit in short mode
+static u16 lfsr_step(u16 lfsr, bool short_mode) {
+    u16 bit = (lfsr ^ (lfsr >> 1)) & 1;
+    lfsr = (lfsr >> 1) | (bit << 14);
+    if (short_mode) lfsr = (lfsr & ~0x40) | (bit << 6);
+    return lfsr;
+}
+
+// Both LFSRs are linear, so 2^k clocks at once is a 15x15 bit matrix,
+// stored as the result for each single set bit
+static u16 lfsr_jumps[2][15][15]; // [short mode][k][bit]
+
+static u16 lfsr_apply(const u16 *cols, u16 lfsr) {
+    u16 out = 0;
+    for (int i = 0; i < 15; i++) {
+        if (BIT(lfsr, i)) out ^= cols[i];
+    }
+    return out;
+}
+
+static bool lfsr_fill_jumps() {
+    for (int mode = 0; mode < 2; mode++) {
+        for (int i = 0; i < 15; i++) lfsr_jumps[mode][0][i] = lfsr_step(1 << i, mode);
+        for (int k = 1; k < 15; k++) {
+            for (int i = 0; i < 15; i++) {
+                lfsr_jumps[mode][k][i] = lfsr_apply(lfsr_jumps[mode][k - 1], lfsr_jumps[mode][k - 1][i]);
+            }
+        }
+    }
+    return true;
+}
+
+static const bool lfsr_jumps_filled = lfsr_fill_jumps();
+
+// steps noise clocks at once. The long LFSR repeats every 32767 clocks.
+// The short one repeats every 127 in its low 7 bits, and after 8 clocks
+// the top 8 bits are only its last few outputs, so they follow suit.
+static u16 lfsr_advance(u16 lfsr, bool short_mode, u64 steps) {
+    if (!short_mode) steps %= 32767;
+    else if (steps >= 8 + 127) steps = 8 + (steps - 8) % 127;
+    for (int k = 0; steps; k++, steps >>= 1) {
+        if (steps & 1) lfsr = lfsr_apply(lfsr_jumps[short_mode][k], lfsr);
+    }
+    return lfsr;
+}
+
+BlipBuffer::BlipBuffer(u32 capacity, double ratio_) : buf(capacity + width, 0), ratio(ratio_) {
+    // Windowed sinc impulse for every sub-sample phase, cut off a bit below
+    // Nyquist and normalized so each phase sums to exactly 1 << 15
+    const double cutoff = 0.9;
+    for (int p = 0; p < phases; p++) {
+        double taps[width];
+        double sum = 0;
+        for (int k = 0; k < width; k++) {
+            double x = k - width / 2 + 1 - (double)p / phases;
+            double sinc = (x == 0) ? 1.0 : sin(M_PI * cutoff * x) / (M_PI * cutoff * x);
+            double window = 0.42 + 0.5 * cos(M_PI * x / (width / 2))
+                + 0.08 * cos(2 * M_PI * x / (width / 2));
+            taps[k] = sinc * window;
+            sum += taps[k];
+        }
+
+        int total = 0;
+        for (int k = 0; k < width; k++) {
+            kernel[p][k] = (int16_t)lround(taps[k] / sum * 32768);
+            total += kernel[p][k];
+        }
+        kernel[p][width / 2] += 32768 - total; // Rounding leftovers
+    }
+}
+
+BlipBuffer::~BlipBuffer() {}
+
+void BlipBuffer::set_ratio(double ratio_, u64 now) {
+    // Re-anchor so samples already placed keep their position
+    base_pos += (now - base_time) * ratio;
+    base_time = now;
+    ratio = ratio_;
+}
+
+void BlipBuffer::add_delta(u64 time, int delta) {
+    double pos = base_pos + (time - base_time) * ratio;
+    u32 i = (u32)pos;
+    if (i + width > buf.size()) return; // Nobody is reading: drop it
+
+    int phase = (int)((pos - i) * phases);
+    for (int k = 0; k < width; k++) {
+        buf[i + k] += delta * kernel[phase][k];
+    }
+    pending = std::max(pending, i + width);
+}
+
+u32 BlipBuffer::samples_ready(u64 now) {
+    // Deltas placed later never touch samples before the current position
+    u32 ready = (u32)(base_pos + (now - base_time) * ratio);
+    return std::min(ready, (u32)(buf.size() - width));
+}
+
+u32 BlipBuffer::read(int16_t *out, u32 count, int stride) {
+    for (u32 i = 0; i < count; i++) {
+        integrator += buf[i];
+        double in = (double)(integrator >> 15);
+
+        // Remove the DC offset like the capacitor on the real output does
+        hp_out = in - hp_in + 0.996 * hp_out;
+        hp_in = in;
+
+        double clamped = std::max(-32768.0, std::min(32767.0, hp_out));
+        out[i * stride] = (int16_t)clamped;
+    }
+
+    // Shift the remaining deltas to the front
+    u32 remaining = pending > count ? pending - count : 0;
+    std::copy(buf.begin() + count, buf.begin() + count + remaining, buf.begin());
+    std::fill(buf.begin() + remaining, buf.begin() + std::max(pending, count), 0);
+    pending = remaining;
+    base_pos -= count;
+
+    return count;
+}
+
+void BlipBuffer::reset(u64 now) {
+    // Pending steps are applied at once rather than dropped, so the level
+    // carries over and restarting the timeline doesn't click
+    for (u32 i = 0; i < pending; i++) integrator += buf[i];
+    std::fill(buf.begin(), buf.begin() + pending, 0);
+    pending = 0;
+    base_time = now;
+    base_pos = 0;
+}
+
+APU::APU(MachineState &state_)
+    : state(state_),
+      left(8192, 48000.0 / CLOCK_RATE),
+      right(8192, 48000.0 / CLOCK_RATE) {
+    reset();
+}
+
+APU::~APU() {}
+
+void APU::reset() {
+    memset(&s, 0, sizeof(s));
+
+    // https://gbdev.io/pandocs/Power_Up_Sequence.html#hardware-registers
+    const u8 power_up[0x17] = {
+        0x80, 0xBF, 0xF3, 0xFF, 0xBF,
+        0xFF, 0x3F, 0x00, 0xFF, 0xBF,
+        0x7F, 0xFF, 0x9F, 0xFF, 0xBF,
+        0xFF, 0xFF, 0x00, 0x00, 0xBF,
+        0x77, 0xF3, 0xF1
+    };
+    memcpy(s.regs, power_up, sizeof(power_up));
+
+    // The boot ROM leaves channel 1 on after its chime has faded out
+    s.square[0].enabled = 1;
+    s.square[0].dac_enabled = 1;
+    s.square[1].dac_enabled = 0;
+    s.noise.lfsr = 0x7FFF;
+
+    s.time = state.cycles;
+    s.next_fs = (state.cycles / FS_PERIOD + 1) * FS_PERIOD;
+
+    // Mixer settings stay, output follows the new timeline
+    left.reset(s.time);
+    right.reset(s.time);
+    refresh_mixer(s.time);
+}
+
+u16 APU::square_freq(int i) {
+    u8 base = 5 * i;
+    return s.regs[base + 3] | ((s.regs[base + 4] & 0b111) << 8);
+}
+
+int APU::square_amp(int i) {
+    SquareState &ch = s.square[i];
+    if (!ch.enabled) return 0;
+    u8 duty = s.regs[5 * i + 1] >> 6;
+    return duty_table[duty][ch.duty_pos] ? ch.volume : 0;
+}
+
+int APU::wave_amp() {
+    if (!s.wave.enabled) return 0;
+    u8 volume_code = (s.regs[NR32] >> 5) & 0b11;
+    if (volume_code == 0) return 0;
+    return s.wave.sample >> (volume_code - 1);
+}
+
+int APU::noise_amp() {
+    if (!s.noise.enabled) return 0;
+    return (~s.noise.lfsr & 1) ? s.noise.volume : 0;
+}
+
+void APU::set_amp(int ch, int val, u64 time) {
+    if (!output_enabled) return;
+
+    // Panning (NR51) and master volume (NR50) are applied per side
+    u8 panning = s.regs[NR51];
+    int vol_left = ((s.regs[NR50] >> 4) & 0b111) + 1;
+    int vol_right = (s.regs[NR50] & 0b111) + 1;
+    int l = BIT(panning, (ch + 4)) ? val * vol_left * MIX_SCALE : 0;
+    int r = BIT(panning, ch) ? val * vol_right * MIX_SCALE : 0;
+
+    if (l != out_left[ch]) {
+        left.add_delta(time, l - out_left[ch]);
+        out_left[ch] = l;
+    }
+    if (r != out_right[ch]) {
+        right.add_delta(time, r - out_right[ch]);
+        out_right[ch] = r;
+    }
+}
+
+void APU::refresh_mixer(u64 time) {
+    set_amp(0, square_amp(0), time);
+    set_amp(1, square_amp(1), time);
+    set_amp(2, wave_amp(), time);
+    set_amp(3, noise_amp(), time);
+}
+
+void APU::run_square(int i, u64 start, u64 end) {
+    SquareState &ch = s.square[i];
+    if (!ch.enabled) return;
+    u32 period = (2048 - square_freq(i)) * 4;
+
+    // Without output only the position matters, so jump straight there
+    u64 t = start + ch.timer;
+    if (!output_enabled) {
+        if (t < end) {
+            u64 steps = (end - t + period - 1) / period;
+            ch.duty_pos = (ch.duty_pos + steps) & 0b111;
+            t += steps * period;
+        }
+        ch.timer = t - end;
+        return;
+    }
+
+    // Step from one duty edge to the next
+    while (t < end) {
+        ch.duty_pos = (ch.duty_pos + 1) & 0b111;
+        set_amp(i, square_amp(i), t);
+        t += period;
+    }
+    ch.timer = t - end;
+}
+
+void APU::run_wave(u64 start, u64 end) {
+    WaveState &ch = s.wave;
+    if (!ch.enabled) return;
+    u16 freq = s.regs[NR33] | ((s.regs[NR34] & 0b111) << 8);
+    u32 period = (2048 - freq) * 2;
+
+    u64 t = start + ch.timer;
+    if (!output_enabled) {
+        if (t < end) {
+            u64 steps = (end - t + period - 1) / period;
+            ch.pos = (ch.pos + steps) & 31;
+            u8 byte = s.regs[WAVE_RAM + ch.pos / 2];
+            ch.sample = (ch.pos & 1) ? (byte & 0xF) : (byte >> 4);
+            t += steps * period;
+        }
+        ch.timer = t - end;
+        return;
+    }
+
+    while (t < end) {
+        ch.pos = (ch.pos + 1) & 31;
+        u8 byte = s.regs[WAVE_RAM + ch.pos / 2];
+        ch.sample = (ch.pos & 1) ? (byte & 0xF) : (byte >> 4);
+        set_amp(2, wave_amp(), t);
+        t += period;
+    }
+    ch.timer = t - end;
+}
+
+void APU::run_noise(u64 start, u64 end) {
+    NoiseState &ch = s.noise;
+    if (!ch.enabled) return;
+    u8 nr43 = s.regs[NR43];
+    u32 divisor = (nr43 & 0b111) ? (nr43 & 0b111) * 16 : 8;
+    u32 period = divisor << (nr43 >> 4);
+    bool short_mode = BIT(nr43, 3);
+
+    u64 t = start + ch.timer;
+    if (!output_enabled) {
+        if (t < end) {
+            u64 steps = (end - t + period - 1) / period;
+            ch.lfsr = lfsr_advance(ch.lfsr, short_mode, steps);
+            t += steps * period;
+        }
+        ch.timer = t - end;
+        return;
+    }
+
+    while (t < end) {
+        ch.lfsr = lfsr_step(ch.lfsr, short_mode);
+        set_amp(3, noise_amp(), t);
+        t += period;
+    }
+    ch.timer = t - end;
+}
+
+void APU::run(u64 until) {
+    while (s.time < until) {
+        // Channels are synthesized in bulk up to the next frame sequencer
+        // step. They advance the same way with output on or off, so save
+        // states don't depend on whether anyone was listening.
+        u64 end = std::min(until, s.next_fs);
+        run_square(0, s.time, end);
+        run_square(1, s.time, end);
+        run_wave(s.time, end);
+        run_noise(s.time, end);
+        s.time = end;
+
+        if (s.time == s.next_fs) {
+            step_frame_sequencer();
+            s.next_fs += FS_PERIOD;
+        }
+    }
+}
+
+void APU::step_length(u8 &enabled, u16 &length, u8 length_enable_reg) {
+    if (!BIT(length_enable_reg, 6) || length == 0) return;
+    if (--length == 0) enabled = 0;
+}
+
+void APU::step_envelope(u8 &volume, u8 &env_timer, u8 envelope_reg) {
+    u8 period = envelope_reg & 0b111;
+    if (period == 0) return;
+    if (--env_timer > 0) return;
+
+    env_timer = period;
+    if (BIT(envelope_reg, 3) && volume < 15) volume++;
+    else if (!BIT(envelope_reg, 3) && volume > 0) volume--;
+}
+
+u16 APU::sweep_target() {
+    SquareState &ch = s.square[0];
+    u16 delta = ch.shadow_freq >> (s.regs[NR10] & 0b111);
+    return BIT(s.regs[NR10], 3) ? ch.shadow_freq - delta : ch.shadow_freq + delta;
+}
+
+void APU::step_frame_sequencer() {
+    u8 step = s.fs_step;
+    s.fs_step = (s.fs_step + 1) & 0b111;
+
+    // Length counters on even steps
+    if ((step & 1) == 0) {
+        step_length(s.square[0].enabled, s.square[0].length, s.regs[NR14]);
+        step_length(s.square[1].enabled, s.square[1].length, s.regs[NR24]);
+        step_length(s.wave.enabled, s.wave.length, s.regs[NR34]);
+        step_length(s.noise.enabled, s.noise.length, s.regs[NR44]);
+    }
+
+    // Channel 1 frequency sweep on steps 2 and 6
+    if (step == 2 || step == 6) {
+        SquareState &ch = s.square[0];
+        u8 period = (s.regs[NR10] >> 4) & 0b111;
+        if (--ch.sweep_timer == 0) {
+            ch.sweep_timer = period ? period : 8;
+            if (ch.sweep_enabled && period) {
+                u16 freq = sweep_target();
+                if (freq > 2047) {
+                    ch.enabled = 0;
+                } else if (s.regs[NR10] & 0b111) {
+                    ch.shadow_freq = freq;
+                    s.regs[NR13] = freq & 0xFF;
+                    s.regs[NR14] = (s.regs[NR14] & ~0b111) | (freq >> 8);
+                    if (sweep_target() > 2047) ch.enabled = 0;
+                }
+            }
+        }
+    }
+
+    // Volume envelopes on step 7
+    if (step == 7) {
+        step_envelope(s.square[0].volume, s.square[0].env_timer, s.regs[NR12]);
+        step_envelope(s.square[1].volume, s.square[1].env_timer, s.regs[NR22]);
+        step_envelope(s.noise.volume, s.noise.env_timer, s.regs[NR42]);
+    }
+
+    refresh_mixer(s.time);
+}
+
+void APU::trigger(int ch) {
+    switch (ch) {
+        case 0:
+        case 1: {
+            SquareState &sq = s.square[ch];
+            u8 base = 5 * ch;
+            sq.enabled = sq.dac_enabled;
+            if (sq.length == 0) sq.length = 64;
+            sq.timer = (2048 - square_freq(ch)) * 4;
+            sq.volume = s.regs[base + 2] >> 4;
+            sq.env_timer = (s.regs[base + 2] & 0b111) ? (s.regs[base + 2] & 0b111) : 8;
+
+            if (ch == 0) {
+                u8 period = (s.regs[NR10] >> 4) & 0b111;
+                u8 shift = s.regs[NR10] & 0b111;
+                sq.shadow_freq = square_freq(0);
+                sq.sweep_timer = period ? period : 8;
+                sq.sweep_enabled = period || shift;
+                if (shift && sweep_target() > 2047) sq.enabled = 0;
+            }
+            break;
+        }
+        case 2: {
+            WaveState &wv = s.wave;
+            u16 freq = s.regs[NR33] | ((s.regs[NR34] & 0b111) << 8);
+            wv.enabled = wv.dac_enabled;
+            if (wv.length == 0) wv.length = 256;
+            wv.timer = (2048 - freq) * 2;
+            wv.pos = 0;
+            break;
+        }
+        case 3: {
+            NoiseState &ns = s.noise;
+            ns.enabled = ns.dac_enabled;
+            if (ns.length == 0) ns.length = 64;
+            ns.volume = s.regs[NR42] >> 4;
+            ns.env_timer = (s.regs[NR42] & 0b111) ? (s.regs[NR42] & 0b111) : 8;
+            ns.lfsr = 0x7FFF;
+            break;
+        }
+    }
+}
+
+void APU::power_off() {
+    // Every register but NR52 and wave RAM is cleared
+    memset(s.regs, 0, NR52);
+    memset(s.square, 0, sizeof(s.square));
+    u8 wave_pos = s.wave.pos;
+    memset(&s.wave, 0, sizeof(s.wave));
+    s.wave.pos = wave_pos;
+    memset(&s.noise, 0, sizeof(s.noise));
+    s.noise.lfsr = 0x7FFF;
+}
+
+u8 APU::read(u16 addr) {
+    // Channel status depends on length counters, so catch up first
+    if (addr == 0xFF26) run(state.cycles);
+    return peek(addr);
+}
+
+u8 APU::peek(u16 addr) {
+    u8 reg = addr - 0xFF10;
+
+    if (reg == NR52) {
+        return (s.regs[NR52] & 0x80) | read_mask[NR52]
+            | (s.noise.enabled << 3) | (s.wave.enabled << 2)
+            | (s.square[1].enabled << 1) | s.square[0].enabled;
+    }
+
+    return s.regs[reg] | read_mask[reg];
+}
+
+void APU::write(u16 addr, u8 val) {
+    u8 reg = addr - 0xFF10;
+
+    // Everything up to now plays with the old register values
+    run(state.cycles);
+
+    if (reg >= WAVE_RAM) {
+        s.regs[reg] = val;
+        return;
+    }
+
+    bool powered = BIT(s.regs[NR52], 7);
+    if (reg == NR52) {
+        if (powered && !BIT(val, 7)) power_off();
+        s.regs[NR52] = val & 0x80;
+        refresh_mixer(state.cycles);
+        return;
+    }
+    if (!powered) return; // Registers are read-only while powered off
+
+    s.regs[reg] = val;
+
+    switch (reg) {
+        case NR11: s.square[0].length = 64 - (val & 0x3F); break;
+        case NR21: s.square[1].length = 64 - (val & 0x3F); break;
+        case NR31: s.wave.length = 256 - val; break;
+        case NR41: s.noise.length = 64 - (val & 0x3F); break;
+
+        // Turning a DAC off also turns its channel off
+        case NR12:
+            s.square[0].dac_enabled = (val & 0xF8) != 0;
+            if (!s.square[0].dac_enabled) s.square[0].enabled = 0;
+            break;
+        case NR22:
+            s.square[1].dac_enabled = (val & 0xF8) != 0;
+            if (!s.square[1].dac_enabled) s.square[1].enabled = 0;
+            break;
+        case NR30:
+            s.wave.dac_enabled = BIT(val, 7);
+            if (!s.wave.dac_enabled) s.wave.enabled = 0;
+            break;
+        case NR42:
+            s.noise.dac_enabled = (val & 0xF8) != 0;
+            if (!s.noise.dac_enabled) s.noise.enabled = 0;
+            break;
+
+        case NR14: if (BIT(val, 7)) trigger(0); break;
+        case NR24: if (BIT(val, 7)) trigger(1); break;
+        case NR34: if (BIT(val, 7)) trigger(2); break;
+        case NR44: if (BIT(val, 7)) trigger(3); break;
+    }
+
+    refresh_mixer(state.cycles);
+}
+
+void APU::set_output_enabled(bool enabled) {
+    if (enabled && !output_enabled) {
+        // Pick up from the level we were at when output stopped
+        run(state.cycles);
+        left.reset(s.time);
+        right.reset(s.time);
+        output_enabled = true;
+        refresh_mixer(s.time);
+    }
+    output_enabled = enabled;
+}
+
+void APU::set_sample_rate(double rate) {
+    run(state.cycles);
+    sample_rate = rate;
+    left.set_ratio(rate / CLOCK_RATE, s.time);
+    right.set_ratio(rate / CLOCK_RATE, s.time);
+}
+
+void APU::end_frame() {
+    run(state.cycles);
+}
+
+u32 APU::read_samples(int16_t *out, u32 max_frames) {
+    if (!output_enabled) return 0;
+
+    u32 count = std::min(left.samples_ready(s.time), max_frames);
+    left.read(out, count, 2);
+    right.read(out + 1, count, 2);
+    return count;
+}
+
+void APU::serialize(SaveState &save) {
+    run(state.cycles);
+    save.apu = s;
+}
+
+void APU::deserialize(const SaveState &save) {
+    s = save.apu;
+
+    // Output restarts at the restored time and steps to the restored levels
+    left.reset(s.time);
+    right.reset(s.time);
+    refresh_mixer(s.time);
+}
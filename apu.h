@@ -0,0 +1,89 @@
+#ifndef APU_H
+#define APU_H
+
+#include "common.h"
+#include "machine_state.h"
+#include "save_state.h"
+#include <vector>
+
+// Band-limited step synthesis: amplitude changes are added as windowed
+// sinc steps at their exact clock time and reading integrates them back,
+// so square edges don't alias and no per-sample filtering is needed.
+class BlipBuffer {
+    private:
+        static const int width = 16;  // Kernel taps
+        static const int phases = 32; // Sub-sample kernel positions
+
+        int16_t kernel[phases][width];
+        std::vector<int32_t> buf; // Pending deltas, buf[0] is the next sample out
+        u32 pending = 0;          // End of the deltas placed so far
+        u64 base_time = 0;        // Clock time at sample position base_pos
+        double base_pos = 0;
+        double ratio;             // Output samples per clock
+        int64_t integrator = 0;
+        double hp_in = 0;         // High-pass filter history
+        double hp_out = 0;
+    public:
+        BlipBuffer(u32 capacity, double ratio_);
+        ~BlipBuffer();
+        void set_ratio(double ratio_, u64 now);
+        void add_delta(u64 time, int delta);
+        u32 samples_ready(u64 now);
+        u32 read(int16_t *out, u32 count, int stride);
+        void reset(u64 now);
+};
+
+// DMG APU: two square channels (the first with sweep), wave and noise.
+//
+// Nothing is ticked per T-cycle. The APU remembers how far it has
+// synthesized and catches up in bulk whenever a sound register is
+// touched or samples are collected at the end of a frame, stepping each
+// channel from one waveform edge to the next.
+class APU {
+    private:
+        MachineState &state;
+        ApuState s; // Registers and channel state, stored as-is in save states
+
+        // Mixer output, none of which is machine state
+        bool output_enabled = false;
+        double sample_rate = 48000;
+        BlipBuffer left;
+        BlipBuffer right;
+        int out_left[4] = {0};  // Channel contribution after panning and volume
+        int out_right[4] = {0};
+
+        void run(u64 until);
+        void run_square(int i, u64 start, u64 end);
+        void run_wave(u64 start, u64 end);
+        void run_noise(u64 start, u64 end);
+        void step_frame_sequencer();
+        void step_length(u8 &enabled, u16 &length, u8 length_enable_reg);
+        void step_envelope(u8 &volume, u8 &env_timer, u8 envelope_reg);
+        u16 sweep_target();
+        void trigger(int ch);
+        void power_off();
+
+        u16 square_freq(int i);
+        int square_amp(int i);
+        int wave_amp();
+        int noise_amp();
+        void set_amp(int ch, int val, u64 time);
+        void refresh_mixer(u64 time);
+    public:
+        APU(MachineState &state_);
+        ~APU();
+        void reset(); // Power-on registers, starting at the current cycle
+        u8 read(u16 addr);
+        u8 peek(u16 addr); // Channel status as of the last catch-up
+        void write(u16 addr, u8 val);
+
+        void set_output_enabled(bool enabled);
+        void set_sample_rate(double rate);
+        void end_frame();
+        u32 read_samples(int16_t *out, u32 max_frames); // Interleaved stereo
+
+        void serialize(SaveState &save);
+        void deserialize(const SaveState &save);
+};
+
+#endif
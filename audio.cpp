@@ -0,0 +1,118 @@
+#include "audio.h"
+
+AudioRing::AudioRing(u32 capacity_frames) : capacity(capacity_frames), mask(capacity_frames - 1) {
+    buf = new int16_t[2 * capacity]();
+}
+
+AudioRing::~AudioRing() {
+    delete[] buf;
+}
+
+u32 AudioRing::write(const int16_t *in, u32 frames) {
+    // Only this side moves head, so a relaxed load of it is enough
+    u32 h = head.load(std::memory_order_relaxed);
+    u32 t = tail.load(std::memory_order_acquire);
+    frames = std::min(frames, capacity - (h - t));
+
+    for (u32 i = 0; i < frames; i++) {
+        u32 pos = (h + i) & mask;
+        buf[2 * pos] = in[2 * i];
+        buf[2 * pos + 1] = in[2 * i + 1];
+    }
+
+    // Publish the frames only after they are in place
+    head.store(h + frames, std::memory_order_release);
+    return frames;
+}
+
+u32 AudioRing::read(int16_t *out, u32 frames) {
+    u32 t = tail.load(std::memory_order_relaxed);
+    u32 h = head.load(std::memory_order_acquire);
+    frames = std::min(frames, h - t);
+
+    for (u32 i = 0; i < frames; i++) {
+        u32 pos = (t + i) & mask;
+        out[2 * i] = buf[2 * pos];
+        out[2 * i + 1] = buf[2 * pos + 1];
+    }
+
+    // Hand the space back only after we're done reading it
+    tail.store(t + frames, std::memory_order_release);
+    return frames;
+}
+
+u32 AudioRing::size() {
+    return head.load(std::memory_order_acquire) - tail.load(std::memory_order_acquire);
+}
+
+u32 AudioRing::get_capacity() {
+    return capacity;
+}
+
+AudioOutput::AudioOutput() : ring(8192) {}
+
+AudioOutput::~AudioOutput() {
+    close();
+}
+
+void AudioOutput::callback(void *userdata, Uint8 *stream, int len) {
+    AudioOutput *out = (AudioOutput*)userdata;
+    int16_t *samples = (int16_t*)stream;
+    u32 frames = len / (2 * sizeof(int16_t));
+
+    // Running dry means the emulator fell behind: play silence for the
+    // rest rather than wait for it
+    u32 got = out->ring.read(samples, frames);
+    memset(samples + 2 * got, 0, (frames - got) * 2 * sizeof(int16_t));
+}
+
+bool AudioOutput::open(int freq) {
+    if (SDL_InitSubSystem(SDL_INIT_AUDIO) != 0) return false;
+
+    SDL_AudioSpec want, have;
+    SDL_zero(want);
+    want.freq = freq;
+    want.format = AUDIO_S16SYS;
+    want.channels = 2;
+    want.samples = 512;
+    want.callback = callback;
+    want.userdata = this;
+    dev = SDL_OpenAudioDevice(nullptr, 0, &want, &have, 0);
+    if (!dev) return false;
+
+    // Sit a couple of device buffers plus a frame's worth above empty, so
+    // the callback always has something and latency stays low
+    rate = have.freq;
+    target = std::min(2.0 * have.samples + rate / 60, ring.get_capacity() / 2.0);
+    fill_avg = target;
+
+    SDL_PauseAudioDevice(dev, 0);
+    return true;
+}
+
+void AudioOutput::close() {
+    if (dev) SDL_CloseAudioDevice(dev);
+    dev = 0;
+}
+
+bool AudioOutput::is_open() {
+    return dev != 0;
+}
+
+double AudioOutput::get_rate() {
+    return rate;
+}
+
+double AudioOutput::adjusted_rate() {
+    // A fuller ring than wanted means we make samples faster than the card
+    // plays them, so make a few less, and the other way around
+    fill_avg = 0.9 * fill_avg + 0.1 * ring.size();
+    double error = (target - fill_avg) / target;
+    error = std::max(-1.0, std::min(1.0, error));
+    return rate * (1.0 + max_rate_delta * error);
+}
+
+void AudioOutput::push(const int16_t *samples, u32 frames) {
+    // Whatever doesn't fit is dropped; rate control keeps that rare
+    ring.write(samples, frames);
+}
@@ -0,0 +1,58 @@
+#ifndef AUDIO_H
+#define AUDIO_H
+
+#include "common.h"
+#include "SDL.h"
+#include <atomic>
+
+// Single producer, single consumer ring of interleaved stereo frames.
+//
+// The emulation thread only moves head and the audio callback only moves
+// tail, so neither side ever takes a lock or waits on the other.
+class AudioRing {
+    private:
+        int16_t *buf;
+        u32 capacity; // In frames, a power of two
+        u32 mask;
+
+        // Kept on separate cache lines so the two threads don't bounce them
+        alignas(64) std::atomic<u32> head{0}; // Total frames written
+        alignas(64) std::atomic<u32> tail{0}; // Total frames read
+    public:
+        AudioRing(u32 capacity_frames);
+        ~AudioRing();
+        u32 write(const int16_t *in, u32 frames);
+        u32 read(int16_t *out, u32 frames);
+        u32 size();
+        u32 get_capacity();
+};
+
+// SDL audio device fed from an AudioRing by its callback.
+//
+// The emulator is paced by the video timer, which never quite matches the
+// sound card's clock. Instead of letting the ring slowly drain or overflow,
+// the rate samples are produced at is nudged by a fraction of a percent
+// depending on how full the ring is (dynamic rate control), which keeps the
+// latency steady without an audible pitch change.
+class AudioOutput {
+    private:
+        SDL_AudioDeviceID dev = 0;
+        AudioRing ring;
+        double rate = 48000;
+        double target = 0;       // Fill level we steer towards, in frames
+        double fill_avg = 0;     // Smoothed fill level
+        const double max_rate_delta = 0.005;
+
+        static void callback(void *userdata, Uint8 *stream, int len);
+    public:
+        AudioOutput();
+        ~AudioOutput();
+        bool open(int freq);
+        void close();
+        bool is_open();
+        double get_rate();
+        double adjusted_rate();
+        void push(const int16_t *samples, u32 frames);
+};
+
+#endif
@@ -0,0 +1,204 @@
+#include "av_dump.h"
+#include "ppu.h"
+#include <sstream>
+#include <cmath>
+
+const int frame_width = 160;
+const int frame_height = 144;
+
+StreamWriter::StreamWriter() {}
+
+StreamWriter::~StreamWriter() {
+    close();
+}
+
+bool StreamWriter::open(const char *path) {
+    ofs.open(path, std::ios::binary | std::ios::trunc);
+    if (ofs.fail()) return false;
+
+    closing = false;
+    failed = false;
+    current.reserve(chunk_size);
+    worker = std::thread(&StreamWriter::run, this);
+    return true;
+}
+
+void StreamWriter::write(const void *data, size_t size) {
+    const u8 *bytes = (const u8*)data;
+    current.insert(current.end(), bytes, bytes + size);
+    if (current.size() >= chunk_size) hand_off();
+}
+
+void StreamWriter::hand_off() {
+    std::unique_lock<std::mutex> guard(lock);
+    full.push_back(std::move(current));
+
+    // Reuse a written chunk if there is one, otherwise grow rather than wait
+    if (!spare.empty()) {
+        current = std::move(spare.back());
+        spare.pop_back();
+    } else {
+        current = std::vector<u8>();
+    }
+    current.clear();
+    current.reserve(chunk_size);
+
+    guard.unlock();
+    wake.notify_one();
+}
+
+void StreamWriter::run() {
+    std::unique_lock<std::mutex> guard(lock);
+    while (true) {
+        wake.wait(guard, [this] { return !full.empty() || closing; });
+        if (full.empty()) return; // Closing and nothing left
+
+        std::vector<u8> chunk = std::move(full.front());
+        full.pop_front();
+
+        // Only the disk write happens outside the lock
+        guard.unlock();
+        ofs.write((char*)chunk.data(), chunk.size());
+        guard.lock();
+
+        if (ofs.fail()) failed = true;
+        spare.push_back(std::move(chunk));
+    }
+}
+
+bool StreamWriter::close() {
+    if (!worker.joinable()) return !failed;
+
+    if (!current.empty()) hand_off();
+    {
+        std::lock_guard<std::mutex> guard(lock);
+        closing = true;
+    }
+    wake.notify_one();
+    worker.join();
+
+    ofs.close();
+    if (ofs.fail()) failed = true;
+    return !failed;
+}
+
+AVDump::AVDump() {}
+
+AVDump::~AVDump() {
+    close();
+}
+
+void AVDump::write_wav_header(std::ostream &os, u64 frames) {
+    // Canonical 44 byte PCM header, little endian
+    u32 data_size = (u32)std::min<u64>(frames * 4, 0xFFFFFFFF - 36);
+    u8 header[44];
+    auto put16 = [&](int pos, u16 val) { header[pos] = val & 0xFF; header[pos + 1] = val >> 8; };
+    auto put32 = [&](int pos, u32 val) { put16(pos, val & 0xFFFF); put16(pos + 2, val >> 16); };
+
+    memcpy(header, "RIFF", 4);
+    put32(4, 36 + data_size);
+    memcpy(header + 8, "WAVEfmt ", 8);
+    put32(16, 16);              // fmt chunk size
+    put16(20, 1);               // PCM
+    put16(22, 2);               // Stereo
+    put32(24, sample_rate);
+    put32(28, sample_rate * 4); // Bytes per second
+    put16(32, 4);               // Bytes per frame
+    put16(34, 16);              // Bits per sample
+    memcpy(header + 36, "data", 4);
+    put32(40, data_size);
+
+    os.write((char*)header, sizeof(header));
+}
+
+bool AVDump::open(const std::string &prefix, bool raw_rgb_, u32 sample_rate_) {
+    raw_rgb = raw_rgb_;
+    sample_rate = sample_rate_;
+    audio_frames = 0;
+
+    std::string video_path = prefix + (raw_rgb ? ".rgb" : ".y4m");
+    audio_path = prefix + ".wav";
+    if (!video.open(video_path.c_str()) || !audio.open(audio_path.c_str())) {
+        std::cout << "Dump files could not be created\n";
+        return false;
+    }
+
+    // Convert the 4 shades once up front, Y'CbCr as BT.601 studio range
+    for (int i = 0; i < 4; i++) {
+        double r = PPU::palette[i][0];
+        double g = PPU::palette[i][1];
+        double b = PPU::palette[i][2];
+        if (raw_rgb) {
+            lut[i][0] = r;
+            lut[i][1] = g;
+            lut[i][2] = b;
+        } else {
+            lut[i][0] = (u8)lround(16 + (65.738 * r + 129.057 * g + 25.064 * b) / 256);
+            lut[i][1] = (u8)lround(128 + (-37.945 * r - 74.494 * g + 112.439 * b) / 256);
+            lut[i][2] = (u8)lround(128 + (112.439 * r - 94.154 * g - 18.285 * b) / 256);
+        }
+    }
+    frame_buf.resize(frame_width * frame_height * 3);
+
+    if (!raw_rgb) {
+        // Frame rate is the exact 4194304 / 70224 Hz
+        std::string header = "YUV4MPEG2 W160 H144 F4194304:70224 Ip A1:1 C444\n";
+        video.write(header.data(), header.size());
+    }
+
+    // Sizes are filled in on close
+    std::ostringstream oss;
+    write_wav_header(oss, 0);
+    std::string wav_header = oss.str();
+    audio.write(wav_header.data(), wav_header.size());
+
+    return true;
+}
+
+void AVDump::add_frame(const u8 *shades) {
+    const int pixels = frame_width * frame_height;
+    u8 *out = frame_buf.data();
+
+    if (raw_rgb) {
+        // Interleaved RGB
+        for (int i = 0; i < pixels; i++) {
+            const u8 *px = lut[shades[i]];
+            out[3 * i] = px[0];
+            out[3 * i + 1] = px[1];
+            out[3 * i + 2] = px[2];
+        }
+    } else {
+        // Y4M frames are a marker followed by the Y, Cb and Cr planes
+        video.write("FRAME\n", 6);
+        for (int i = 0; i < pixels; i++) {
+            const u8 *px = lut[shades[i]];
+            out[i] = px[0];
+            out[pixels + i] = px[1];
+            out[2 * pixels + i] = px[2];
+        }
+    }
+
+    video.write(out, frame_buf.size());
+}
+
+void AVDump::add_audio(const int16_t *samples, u32 frames) {
+    // WAV wants little endian, which is what we run on
+    audio.write(samples, frames * 2 * sizeof(int16_t));
+    audio_frames += frames;
+}
+
+bool AVDump::close() {
+    if (audio_path.empty()) return true;
+
+    bool ok = video.close();
+    ok = audio.close() && ok;
+
+    // Go back and fill in the sizes now that they are known
+    std::fstream fs(audio_path, std::ios::binary | std::ios::in | std::ios::out);
+    if (fs.fail()) ok = false;
+    else write_wav_header(fs, audio_frames);
+    fs.close();
+
+    audio_path.clear();
+    return ok;
+}
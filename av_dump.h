@@ -0,0 +1,61 @@
+#ifndef AV_DUMP_H
+#define AV_DUMP_H
+
+#include "common.h"
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+
+// File output drained by its own thread.
+//
+// Writes are copied into large chunks; full chunks are handed to the
+// writer thread and the caller moves on to a fresh one, so a slow disk
+// never holds up whoever is producing the data.
+class StreamWriter {
+    private:
+        const size_t chunk_size = 4 * 1024 * 1024;
+
+        std::ofstream ofs;
+        std::vector<u8> current;
+        std::deque<std::vector<u8>> full;  // Waiting to be written
+        std::vector<std::vector<u8>> spare; // Written and ready for reuse
+        std::mutex lock;
+        std::condition_variable wake;
+        std::thread worker;
+        bool closing = false;
+        bool failed = false;
+
+        void run();
+        void hand_off();
+    public:
+        StreamWriter();
+        ~StreamWriter();
+        bool open(const char *path);
+        void write(const void *data, size_t size);
+        bool close();
+};
+
+// Dumps video as Y4M (or headerless RGB24) and audio as 16-bit stereo WAV
+class AVDump {
+    private:
+        StreamWriter video;
+        StreamWriter audio;
+        std::string audio_path;
+        bool raw_rgb = false;
+        u32 sample_rate = 48000;
+        u64 audio_frames = 0;
+        u8 lut[4][3];                  // Y'CbCr or RGB for each shade
+        std::vector<u8> frame_buf;     // One converted frame
+
+        void write_wav_header(std::ostream &os, u64 frames);
+    public:
+        AVDump();
+        ~AVDump();
+        bool open(const std::string &prefix, bool raw_rgb_, u32 sample_rate_);
+        void add_frame(const u8 *shades); // 160x144 shades, as PPU::get_frame gives
+        void add_audio(const int16_t *samples, u32 frames);
+        bool close();
+};
+
+#endif
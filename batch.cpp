@@ -0,0 +1,208 @@
+#include "movie.h"
+#include "thread_pool.h"
+#include <sstream>
+#include <memory>
+#include <chrono>
+
+// gb-batch: runs a list of headless jobs across every core.
+//
+// The job list has one job per line, blank lines and # comments skipped:
+//
+//     path/to/rom [start:]frames [output]
+//     path/to/rom:movie [output]
+//
+// where output is a .ppm screenshot or a .state save state of the last
+// frame, or left out to just run. A job with a start runs that many
+// frames first; with -c they come from a snapshot cache after the first
+// time, so jobs sharing an intro only emulate it once between them.
+// A job with a movie starts from the movie's state and plays its inputs
+// to the end instead, failing if it doesn't end where the recording did.
+
+struct Job {
+    std::string rom;
+    std::string movie;
+    u64 start = 0;
+    u64 frames = 0;
+    std::string output;
+
+    // Filled in by whichever worker runs it
+    bool ok = false;
+    double seconds = 0;
+    u64 emulated = 0; // Frames actually run, the start included unless cached
+};
+
+// What each worker keeps between jobs. Jobs on the same ROM reuse the
+// instance by going back to the state it was in right after loading.
+struct Worker {
+    std::unique_ptr<Emulator> emu;
+    std::string rom;
+};
+
+bool ends_with(const std::string &str, const std::string &suffix) {
+    return str.size() >= suffix.size()
+        && str.compare(str.size() - suffix.size(), suffix.size(), suffix) == 0;
+}
+
+// Takes "frames" or "start:frames"
+bool parse_frames(const std::string &str, Job &job) {
+    unsigned long long start = 0, frames = 0;
+    int used = 0;
+    if (sscanf(str.c_str(), "%llu:%llu%n", &start, &frames, &used) != 2 || used != (int)str.size()) {
+        start = 0;
+        if (sscanf(str.c_str(), "%llu%n", &frames, &used) != 1 || used != (int)str.size()) return false;
+    }
+    job.start = start;
+    job.frames = frames;
+    return true;
+}
+
+bool read_jobs(const char *path, std::vector<Job> &jobs) {
+    std::ifstream ifs;
+    ifs.open(path);
+    if (ifs.fail()) {
+        std::cout << "Job list failed to open\n";
+        return false;
+    }
+
+    std::string line;
+    int line_num = 0;
+    while (std::getline(ifs, line)) {
+        line_num++;
+        if (line.empty() || line[0] == '#') continue;
+
+        std::istringstream iss(line);
+        Job job;
+        std::string frames;
+        bool ok = (bool)(iss >> job.rom);
+        size_t colon = job.rom.rfind(':');
+        if (ok && colon != std::string::npos) {
+            // Frames come from the movie
+            job.movie = job.rom.substr(colon + 1);
+            job.rom = job.rom.substr(0, colon);
+            ok = !job.rom.empty() && !job.movie.empty();
+        } else {
+            ok = ok && (iss >> frames) && parse_frames(frames, job);
+        }
+        if (!ok) {
+            std::cout << "Job list line " << line_num << " is malformed\n";
+            return false;
+        }
+        iss >> job.output;
+        jobs.push_back(job);
+    }
+    return true;
+}
+
+void run_job(Job &job, Worker &worker, SnapshotCache *cache) {
+    auto start = std::chrono::steady_clock::now();
+
+    // One emulator per worker, reset in place between jobs. The reset
+    // point also restores cartridge RAM, so jobs can't see each other.
+    if (!worker.emu) worker.emu.reset(new Emulator());
+    if (worker.rom == job.rom) {
+        worker.emu->reset();
+    } else {
+        worker.rom.clear();
+        if (!worker.emu->load_rom(job.rom.c_str())) return;
+        worker.emu->set_reset_point();
+        worker.rom = job.rom;
+    }
+    Emulator &emu = *worker.emu;
+    emu.set_joypad(0);
+
+    if (!job.movie.empty()) {
+        Movie movie;
+        if (!movie.load_file(job.movie.c_str()) || !movie.rewind(emu)) return;
+        job.frames = movie.frames();
+        for (u64 i = 0; i < job.frames; i++) {
+            emu.set_joypad(movie.input(i));
+            if (!emu.run_frame()) return;
+            job.emulated++;
+        }
+        if (movie.has_end() && !movie.matches_end(emu)) {
+            std::cout << job.rom << ": replay of " << job.movie << " desynced from the recording\n";
+            return;
+        }
+    } else {
+        u64 frames = job.start + job.frames;
+        if (cache && job.start > 0) {
+            StartSpec spec;
+            spec.frames = job.start;
+            bool cached;
+            if (!emu.warm_start(*cache, spec, &cached)) return;
+            if (!cached) job.emulated += job.start;
+            frames = job.frames;
+        }
+
+        for (u64 i = 0; i < frames; i++) {
+            if (!emu.run_frame()) return;
+            job.emulated++;
+        }
+    }
+
+    job.ok = true;
+    if (ends_with(job.output, ".ppm")) {
+        job.ok = emu.save_screenshot(job.output.c_str());
+    } else if (ends_with(job.output, ".state")) {
+        SaveState save;
+        emu.save_state(save);
+        job.ok = save.save_file(job.output.c_str());
+    }
+
+    std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+    job.seconds = elapsed.count();
+}
+
+int main(int argc, char** argv) {
+    int threads = 0;
+    std::unique_ptr<SnapshotCache> cache;
+    int opt;
+    while ((opt = getopt(argc, argv, "j:c:")) != -1) {
+        switch (opt) {
+            case 'j': threads = atoi(optarg); break;
+            case 'c': cache.reset(new SnapshotCache(optarg)); break;
+        }
+    }
+    if (optind >= argc) {
+        std::cout << "usage: gb-batch [-j threads] [-c cache_dir] jobs.txt\n";
+        return -1;
+    }
+
+    std::vector<Job> jobs;
+    if (!read_jobs(argv[optind], jobs)) return -1;
+
+    auto start = std::chrono::steady_clock::now();
+    {
+        ThreadPool pool(threads);
+        std::vector<Worker> workers(pool.size());
+        for (Job &job : jobs) {
+            pool.submit([&job, &workers, &cache](int w) { run_job(job, workers[w], cache.get()); });
+        }
+        pool.wait();
+        threads = pool.size();
+    }
+    std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+
+    // Report in job order, whatever order they finished in. Throughput
+    // counts every frame emulated, failed jobs and uncached starts too.
+    u64 total_frames = 0;
+    int failed = 0;
+    for (Job &job : jobs) {
+        std::cout << (job.ok ? "ok   " : "FAIL ") << job.rom << " ";
+        if (!job.movie.empty()) std::cout << job.movie << " ";
+        if (job.start > 0) std::cout << job.start << ":";
+        std::cout << job.frames;
+        if (!job.output.empty()) std::cout << " -> " << job.output;
+        std::cout << std::fixed << std::setprecision(3) << " (" << job.seconds << " s)\n";
+        total_frames += job.emulated;
+        if (!job.ok) failed++;
+    }
+
+    double fps = total_frames / elapsed.count();
+    std::cout << std::fixed << std::setprecision(1)
+        << jobs.size() << " jobs, " << failed << " failed, "
+        << total_frames << " frames in " << elapsed.count() << " s on " << threads << " threads: "
+        << fps << " frames/s, " << fps / threads << " frames/s per thread\n";
+
+    return failed ? -2 : 0;
+}
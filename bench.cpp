@@ -0,0 +1,296 @@
+#include "movie.h"
+#include "event_handler.h"
+#include <memory>
+#include <chrono>
+#include <vector>
+#include <cstdio>
+
+// gb-bench: measures the emulator so performance changes can be judged
+// on numbers.
+//
+//     gb-bench [-f frames] [-r repeats] [-o out.json] [-b baseline.json]
+//              [-t percent] [rom[:movie]]...
+//
+// Every ROM runs headlessly for the given number of frames (playing the
+// movie's inputs from its start state if there is one) and reports
+// frames/s, emulated MHz and ns per instruction. Microbenchmarks time the
+// hot calls on their own: bus reads and writes, decoding and executing,
+// rendering a scanline, timer ticks and cartridge reads. Each number,
+// ROM runs included, is the best of -r repeats (default 5).
+//
+// Results go to a JSON file. Given a baseline written the same way, any
+// result more than -t percent (default 5) worse than it is flagged as a
+// regression and the exit status says so.
+
+struct Result {
+    std::string name;
+    std::string unit;
+    double value;
+    bool higher_is_better;
+};
+
+// The parts the microbenchmarks call into, around a blank cartridge
+struct BenchMachine {
+    MachineState state;
+    Cartridge cart;
+    Joypad joypad;
+    Timer timer;
+    APU apu;
+    IO io;
+    EventHandler event_handler;
+    PPU ppu;
+    MemoryBus bus;
+    CPU cpu;
+
+    BenchMachine()
+        : timer(state), apu(state), io(state, joypad, timer, apu), event_handler(joypad, io),
+          ppu(state, event_handler, true), bus(state, cart, io, ppu, timer), cpu(state, bus) {
+        // 32 KB, no MBC, filled with something other than zeroes
+        std::vector<u8> rom(0x8000);
+        for (size_t i = 0; i < rom.size(); i++) rom[i] = (u8)(i * 7 + (i >> 8));
+        rom[0x147] = 0x00;
+        rom[0x148] = 0x00;
+        cart.load_rom(rom.data(), rom.size());
+    }
+};
+
+volatile u32 sink; // Keeps results alive so loops aren't optimized away
+
+// Best of repeats runs of body, in ns per iteration
+template <typename Body>
+double best_ns(int repeats, u64 iterations, Body body) {
+    double best = 1e30;
+    for (int r = 0; r < repeats; r++) {
+        auto start = std::chrono::steady_clock::now();
+        body(iterations);
+        std::chrono::duration<double, std::nano> elapsed = std::chrono::steady_clock::now() - start;
+        best = std::min(best, elapsed.count() / iterations);
+    }
+    return best;
+}
+
+void run_micro(std::vector<Result> &results, int repeats) {
+    std::unique_ptr<BenchMachine> m(new BenchMachine());
+
+    // A spread of the regions games touch most
+    const u16 read_addrs[] = {0x0150, 0x4000, 0x7FF0, 0x8000, 0x9800, 0xC000, 0xC123, 0xDFFF,
+                              0xFE00, 0xFF00, 0xFF44, 0xFF80, 0xFFFE, 0xFFFF, 0x2000, 0xD000};
+    const u16 write_addrs[] = {0x8000, 0x9800, 0xC000, 0xC123, 0xDFFF, 0xFE00, 0xFF80, 0xFFFE};
+
+    double ns = best_ns(repeats, 1 << 22, [&](u64 n) {
+        u32 sum = 0;
+        for (u64 i = 0; i < n; i++) sum += m->bus.read(read_addrs[i & 15]);
+        sink = sum;
+    });
+    results.push_back({"MemoryBus::read", "ns/op", ns, false});
+
+    ns = best_ns(repeats, 1 << 22, [&](u64 n) {
+        for (u64 i = 0; i < n; i++) m->bus.write(write_addrs[i & 7], (u8)i);
+    });
+    results.push_back({"MemoryBus::write", "ns/op", ns, false});
+
+    ns = best_ns(repeats, 1 << 22, [&](u64 n) {
+        u32 sum = 0;
+        for (u64 i = 0; i < n; i++) sum += m->cart.read((u16)(i * 97) & 0x7FFF);
+        sink = sum;
+    });
+    results.push_back({"Cartridge::read", "ns/op", ns, false});
+
+    m->state.TAC = 0x05; // Enabled, fastest rate
+    ns = best_ns(repeats, 1 << 22, [&](u64 n) {
+        u32 fired = 0;
+        for (u64 i = 0; i < n; i++) fired += m->timer.tick();
+        sink = fired;
+    });
+    results.push_back({"Timer::tick", "ns/op", ns, false});
+
+    // Register-only loads and ALU ops plus the (HL) forms, HL in WRAM;
+    // HALT and LD B,B (the test breakpoint) are left out
+    std::vector<u8> opcodes;
+    for (int op = 0x41; op <= 0xBF; op++) {
+        if (op != 0x76) opcodes.push_back(op);
+    }
+    ns = best_ns(repeats, 1 << 21, [&](u64 n) {
+        for (u64 i = 0; i < n; i++) {
+            m->state.regs.H = 0xC0;
+            m->state.regs.L = 0x00;
+            m->cpu.decode_and_execute(opcodes[i % opcodes.size()]);
+        }
+    });
+    results.push_back({"CPU::decode_and_execute", "ns/op", ns, false});
+
+    // Background, window and a full set of sprites on every line
+    m->state.LCDC = 0xF3;
+    m->state.WX = 87;
+    m->state.WY = 0;
+    for (u16 i = 0; i < 40; i++) {
+        m->bus.write(0xFE00 + 4 * i, 16 + (i % 10) * 16);
+        m->bus.write(0xFE01 + 4 * i, 8 + i * 4);
+        m->bus.write(0xFE02 + 4 * i, i);
+    }
+    for (u16 addr = 0x8000; addr < 0x9800; addr++) m->bus.write(addr, (u8)(addr * 13));
+    ns = best_ns(repeats, 1 << 14, [&](u64 n) {
+        for (u64 i = 0; i < n; i++) {
+            m->state.LY = i % 144;
+            m->ppu.render_scanline();
+        }
+    });
+    results.push_back({"PPU::render_scanline", "ns/op", ns, false});
+}
+
+std::string base_name(const std::string &path) {
+    size_t slash = path.find_last_of('/');
+    return slash == std::string::npos ? path : path.substr(slash + 1);
+}
+
+bool run_rom(std::vector<Result> &results, const std::string &arg, u64 frames, int repeats) {
+    std::string rom = arg;
+    std::string movie_path;
+    size_t colon = arg.rfind(':');
+    if (colon != std::string::npos) {
+        rom = arg.substr(0, colon);
+        movie_path = arg.substr(colon + 1);
+    }
+
+    Emulator emu;
+    if (!emu.load_rom(rom.c_str())) return false;
+    Movie movie;
+    bool playing = !movie_path.empty();
+    if (playing && (!movie.load_file(movie_path.c_str()) || !movie.rewind(emu))) return false;
+
+    // Every repeat starts over from the same state, so runs the same frames
+    std::unique_ptr<SaveState> start_state(new SaveState());
+    emu.save_state(*start_state);
+
+    double elapsed = 0;
+    u64 cycles = 0, instructions = 0;
+    for (int r = 0; r < repeats; r++) {
+        if (!emu.load_state(*start_state)) return false;
+        u64 start_cycles = emu.get_cycles();
+        u64 start_instructions = emu.get_instructions();
+        auto start = std::chrono::steady_clock::now();
+        for (u64 i = 0; i < frames; i++) {
+            if (playing) emu.set_joypad(movie.input(i));
+            if (!emu.run_frame()) return false;
+        }
+        std::chrono::duration<double> took = std::chrono::steady_clock::now() - start;
+        if (r == 0 || took.count() < elapsed) elapsed = took.count();
+        cycles = emu.get_cycles() - start_cycles;
+        instructions = emu.get_instructions() - start_instructions;
+    }
+
+    std::string name = base_name(rom);
+    if (playing) name += "+" + base_name(movie_path);
+    results.push_back({name + " frames/s", "frames/s", frames / elapsed, true});
+    results.push_back({name + " MHz", "MHz", cycles / elapsed / 1e6, true});
+    results.push_back({name + " ns/instruction", "ns", elapsed * 1e9 / instructions, false});
+    return true;
+}
+
+bool write_results(const char *path, const std::vector<Result> &results, u64 frames) {
+    std::ofstream ofs;
+    ofs.open(path);
+    if (ofs.fail()) {
+        std::cout << "Results file failed to be created\n";
+        return false;
+    }
+    // One result per line, which is also what read_results expects
+    ofs << "{\n  \"frames\": " << frames << ",\n  \"results\": [\n";
+    for (size_t i = 0; i < results.size(); i++) {
+        const Result &r = results[i];
+        ofs << "    {\"name\": \"" << r.name << "\", \"unit\": \"" << r.unit << "\", \"value\": "
+            << std::setprecision(6) << r.value << ", \"higher_is_better\": "
+            << (r.higher_is_better ? "true" : "false") << "}" << (i + 1 < results.size() ? "," : "") << "\n";
+    }
+    ofs << "  ]\n}\n";
+    return !ofs.fail();
+}
+
+bool read_results(const char *path, std::vector<Result> &results) {
+    std::ifstream ifs;
+    ifs.open(path);
+    if (ifs.fail()) return false;
+
+    std::string line;
+    while (std::getline(ifs, line)) {
+        char name[256], unit[32], better[8];
+        double value;
+        if (sscanf(line.c_str(), " {\"name\": \"%255[^\"]\", \"unit\": \"%31[^\"]\", \"value\": %lf, \"higher_is_better\": %7[a-z]",
+                   name, unit, &value, better) == 4) {
+            results.push_back({name, unit, value, strcmp(better, "true") == 0});
+        }
+    }
+    return true;
+}
+
+// Prints every result next to its baseline; returns how many got worse
+int compare(const std::vector<Result> &results, const std::vector<Result> &baseline, double tolerance) {
+    int regressions = 0;
+    std::cout << std::left << std::setw(40) << "benchmark" << std::right << std::setw(12) << "baseline"
+              << std::setw(12) << "now" << std::setw(10) << "change" << "\n";
+    for (const Result &r : results) {
+        const Result *base = nullptr;
+        for (const Result &b : baseline) {
+            if (b.name == r.name) base = &b;
+        }
+
+        std::cout << std::left << std::setw(40) << r.name << std::right << std::fixed << std::setprecision(2);
+        if (!base || base->value <= 0) {
+            std::cout << std::setw(12) << "-" << std::setw(12) << r.value << "\n";
+            continue;
+        }
+
+        // Positive is worse, whichever way the unit goes
+        double change = (r.value - base->value) / base->value * 100;
+        double worse = r.higher_is_better ? -change : change;
+        std::cout << std::setw(12) << base->value << std::setw(12) << r.value
+                  << std::setw(9) << std::showpos << change << std::noshowpos << "%";
+        if (worse > tolerance) {
+            std::cout << "  REGRESSION";
+            regressions++;
+        }
+        std::cout << "\n";
+    }
+    return regressions;
+}
+
+int main(int argc, char** argv) {
+    u64 frames = 600;
+    int repeats = 5;
+    const char *out_path = nullptr;
+    const char *baseline_path = nullptr;
+    double tolerance = 5;
+    int opt;
+    while ((opt = getopt(argc, argv, "f:r:o:b:t:")) != -1) {
+        switch (opt) {
+            case 'f': frames = strtoull(optarg, nullptr, 10); break;
+            case 'r': repeats = std::max(1, atoi(optarg)); break;
+            case 'o': out_path = optarg; break;
+            case 'b': baseline_path = optarg; break;
+            case 't': tolerance = atof(optarg); break;
+            default:
+                std::cout << "usage: gb-bench [-f frames] [-r repeats] [-o out.json] [-b baseline.json] [-t percent] [rom[:movie]]...\n";
+                return -1;
+        }
+    }
+
+    std::vector<Result> results;
+    run_micro(results, repeats);
+    for (int i = optind; i < argc; i++) {
+        if (!run_rom(results, argv[i], frames, repeats)) {
+            std::cout << argv[i] << " could not be run\n";
+            return -1;
+        }
+    }
+
+    if (out_path && !write_results(out_path, results, frames)) return -1;
+
+    std::vector<Result> baseline;
+    if (baseline_path && !read_results(baseline_path, baseline)) {
+        std::cout << "No baseline at " << baseline_path << ", nothing to compare against\n";
+    }
+    int regressions = compare(results, baseline, tolerance);
+    if (regressions) std::cout << regressions << " regressions over " << tolerance << "%\n";
+
+    return regressions ? -2 : 0;
+}
@@ -4,6 +4,8 @@
 #include <iostream>
 #include <fstream>
 #include <cstdint>
+#include <cstring>
+#include <string>
 #include <iomanip>
 #include <deque>
 #include <algorithm>
@@ -0,0 +1,201 @@
+#include "emulator.h"
+#include "thread_pool.h"
+#include <memory>
+#include <chrono>
+#include <sstream>
+#include <ftw.h>
+
+// gb-test: runs test ROMs headlessly on every core and sums up.
+//
+//     gb-test [-j threads] [-b seconds] path...
+//
+// Paths are ROMs or directories searched for .gb and .gbc files. A test
+// passes or fails as soon as one of these says so:
+//   - serial output containing "Passed" or "Failed" (blargg)
+//   - LD B,B with B,C,D,E,H,L set to 3,5,8,13,21,34 to pass or all 0x42
+//     to fail (mooneye)
+//   - for ROMs with a rom.hash file next to them holding a picture hash
+//     (as from gb-emu --hashes), the picture at LD B,B or once the budget
+//     runs out (dmg-acid2 and other screenshot tests)
+// Anything else gets the budget, in emulated seconds (default 120), and
+// then counts as timed out.
+
+typedef enum {
+    Result_Timeout,
+    Result_Pass,
+    Result_Fail,
+    Result_Error
+} test_result;
+
+struct Test {
+    std::string rom;
+    bool has_hash = false;
+    u64 hash = 0;
+
+    // Filled in by whichever worker runs it
+    test_result result = Result_Error;
+    std::string how;      // What decided the result
+    std::string serial;   // End of the serial output
+    double emulated = 0;  // Seconds of Game Boy time
+    double seconds = 0;
+};
+
+const double clock_rate = 4194304.0;
+
+std::vector<Test> *found_tests = nullptr; // nftw has no user pointer
+
+int add_rom(const char *path, const struct stat *, int type, struct FTW *) {
+    std::string name = path;
+    size_t dot = name.rfind('.');
+    std::string ext = dot == std::string::npos ? "" : name.substr(dot);
+    if (type == FTW_F && (ext == ".gb" || ext == ".gbc")) {
+        Test test;
+        test.rom = name;
+        found_tests->push_back(test);
+    }
+    return 0;
+}
+
+bool find_tests(int count, char **paths, std::vector<Test> &tests) {
+    found_tests = &tests;
+    for (int i = 0; i < count; i++) {
+        if (nftw(paths[i], add_rom, 16, FTW_PHYS) != 0) {
+            std::cout << "Could not search " << paths[i] << std::endl;
+            return false;
+        }
+    }
+    std::sort(tests.begin(), tests.end(), [](const Test &a, const Test &b) { return a.rom < b.rom; });
+
+    // Screenshot tests come with the hash of the right picture
+    for (Test &test : tests) {
+        std::ifstream ifs;
+        ifs.open(test.rom + ".hash");
+        if (!ifs.fail() && (ifs >> std::hex >> test.hash)) test.has_hash = true;
+    }
+    return true;
+}
+
+// Whether the serial output or registers say the test is over
+bool check_done(Test &test, Emulator &emu, bool breakpoint) {
+    const std::string &serial = emu.serial_output();
+    if (serial.find("Passed") != std::string::npos) {
+        test.result = Result_Pass;
+        test.how = "serial";
+        return true;
+    }
+    if (serial.find("Failed") != std::string::npos) {
+        test.result = Result_Fail;
+        test.how = "serial";
+        return true;
+    }
+    if (!breakpoint) return false;
+
+    if (test.has_hash) {
+        test.result = emu.frame_hash() == test.hash ? Result_Pass : Result_Fail;
+        test.how = "picture";
+        return true;
+    }
+    Registers r = emu.get_registers();
+    if (r.B == 3 && r.C == 5 && r.D == 8 && r.E == 13 && r.H == 21 && r.L == 34) {
+        test.result = Result_Pass;
+        test.how = "registers";
+        return true;
+    }
+    if (r.B == 0x42 && r.C == 0x42 && r.D == 0x42 && r.E == 0x42 && r.H == 0x42 && r.L == 0x42) {
+        test.result = Result_Fail;
+        test.how = "registers";
+        return true;
+    }
+    return false;
+}
+
+void run_test(Test &test, std::unique_ptr<Emulator> &emu, u64 budget) {
+    auto start = std::chrono::steady_clock::now();
+
+    if (!emu) emu.reset(new Emulator());
+    if (!emu->load_rom(test.rom.c_str())) {
+        test.how = "ROM could not be loaded";
+        return;
+    }
+
+    test.result = Result_Timeout;
+    bool done = false;
+    while (!done && emu->get_cycles() < budget) {
+        if (!emu->run_frame()) {
+            test.result = Result_Error;
+            test.how = "CPU could not step";
+            break;
+        }
+        done = check_done(test, *emu, emu->take_breakpoint());
+    }
+
+    // Screenshot tests that never signal are judged on where they ended up
+    if (!done && test.result == Result_Timeout && test.has_hash) {
+        test.result = emu->frame_hash() == test.hash ? Result_Pass : Result_Fail;
+        test.how = "picture";
+    }
+
+    const std::string &out = emu->serial_output();
+    test.serial = out.substr(out.size() > 240 ? out.size() - 240 : 0);
+    test.emulated = emu->get_cycles() / clock_rate;
+    std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+    test.seconds = elapsed.count();
+}
+
+int main(int argc, char** argv) {
+    int threads = 0;
+    double budget_seconds = 120;
+    int opt;
+    while ((opt = getopt(argc, argv, "j:b:")) != -1) {
+        switch (opt) {
+            case 'j': threads = atoi(optarg); break;
+            case 'b': budget_seconds = atof(optarg); break;
+        }
+    }
+    if (optind >= argc) {
+        std::cout << "usage: gb-test [-j threads] [-b seconds] path...\n";
+        return -1;
+    }
+
+    std::vector<Test> tests;
+    if (!find_tests(argc - optind, argv + optind, tests)) return -1;
+    u64 budget = (u64)(budget_seconds * clock_rate);
+
+    auto start = std::chrono::steady_clock::now();
+    {
+        ThreadPool pool(threads);
+        std::vector<std::unique_ptr<Emulator>> emus(pool.size());
+        for (Test &test : tests) {
+            pool.submit([&test, &emus, budget](int w) { run_test(test, emus[w], budget); });
+        }
+        pool.wait();
+        threads = pool.size();
+    }
+    std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+
+    // Report in name order, whatever order they finished in
+    const char *labels[] = {"TIME ", "PASS ", "FAIL ", "ERROR"};
+    int counts[4] = {0};
+    for (Test &test : tests) {
+        counts[test.result]++;
+        std::cout << labels[test.result] << " " << test.rom << std::fixed << std::setprecision(1)
+            << " (" << (test.how.empty() ? "no result" : test.how) << ", "
+            << test.emulated << " emulated s, " << std::setprecision(3) << test.seconds << " s)\n";
+
+        // The end of the serial output usually says what went wrong
+        if (test.result != Result_Pass && !test.serial.empty()) {
+            std::istringstream lines(test.serial);
+            std::string line;
+            while (std::getline(lines, line)) {
+                if (!line.empty()) std::cout << "      " << line << "\n";
+            }
+        }
+    }
+
+    std::cout << std::fixed << std::setprecision(1)
+        << tests.size() << " tests: " << counts[Result_Pass] << " passed, " << counts[Result_Fail]
+        << " failed, " << counts[Result_Timeout] << " timed out, " << counts[Result_Error]
+        << " errors in " << elapsed.count() << " s on " << threads << " threads\n";
+
+    return counts[Result_Pass] == (int)tests.size() ? 0 : -2;
+}
@@ -0,0 +1,68 @@
+#include "counters.h"
+#include <vector>
+
+#ifdef GB_COUNTERS
+thread_local Counters gb_counters;
+#else
+thread_local Counters unused_counters; // Stays zero
+#endif
+
+bool counters_enabled() {
+#ifdef GB_COUNTERS
+    return true;
+#else
+    return false;
+#endif
+}
+
+Counters &thread_counters() {
+#ifdef GB_COUNTERS
+    return gb_counters;
+#else
+    return unused_counters;
+#endif
+}
+
+void reset_counters() {
+    thread_counters() = Counters();
+}
+
+// Largest entries of a table, most first
+void print_top(std::ostream &out, const char *title, const u64 *counts, int size, int base, int width, int top) {
+    std::vector<int> order;
+    u64 total = 0;
+    for (int i = 0; i < size; i++) {
+        total += counts[i];
+        if (counts[i]) order.push_back(i);
+    }
+    std::sort(order.begin(), order.end(), [counts](int a, int b) { return counts[a] > counts[b]; });
+    if (order.size() > (size_t)top) order.resize(top);
+
+    out << title << ": " << std::dec << total << "\n";
+    for (int i : order) {
+        out << "  " << std::hex << std::setw(width) << std::setfill('0') << base + i << std::setfill(' ')
+            << std::dec << std::setw(14) << counts[i] << std::fixed << std::setprecision(1) << std::setw(7)
+            << 100.0 * counts[i] / total << "%\n";
+    }
+}
+
+void print_counters(std::ostream &out, const Counters &c) {
+    const char *regions[Region_Count] = {"ROM", "VRAM", "ERAM", "WRAM", "Echo", "OAM", "Unusable", "IO", "HRAM", "IE"};
+    out << std::setfill(' ') << "Bus accesses           reads        writes\n";
+    for (int i = 0; i < Region_Count; i++) {
+        out << "  " << std::left << std::setw(9) << regions[i] << std::right << std::dec
+            << std::setw(14) << c.bus_reads[i] << std::setw(14) << c.bus_writes[i] << "\n";
+    }
+    print_top(out, "IO reads", c.io_reads, 0x80, 0xFF00, 4, 12);
+    print_top(out, "IO writes", c.io_writes, 0x80, 0xFF00, 4, 12);
+    print_top(out, "Opcodes", c.opcodes, 0x100, 0, 2, 24);
+    print_top(out, "CB opcodes", c.cb_opcodes, 0x100, 0, 2, 12);
+
+    u64 cycles = c.cycles_running + c.cycles_halted;
+    out << std::dec << "M-cycles: " << cycles << " (" << c.cycles_running << " running, " << c.cycles_halted
+        << " halted, " << std::fixed << std::setprecision(1) << (cycles ? 100.0 * c.cycles_halted / cycles : 0.0) << "% halted)\n";
+    out << "Interrupts: VBlank " << c.interrupts[0] << ", LCD STAT " << c.interrupts[1] << ", Timer "
+        << c.interrupts[2] << ", Serial " << c.interrupts[3] << ", Joypad " << c.interrupts[4] << "\n";
+    out << "Bank switches: ROM " << c.rom_bank_switches << ", RAM " << c.ram_bank_switches << "\n";
+    out << "Scanlines: " << c.scanlines_rendered << " rendered, " << c.scanlines_skipped << " skipped\n";
+}
@@ -0,0 +1,56 @@
+#ifndef COUNTERS_H
+#define COUNTERS_H
+
+#include "common.h"
+
+// Hot path event counters, for finding where emulated time goes.
+//
+// Only compiled in with -DGB_COUNTERS (make COUNTERS=1); otherwise the
+// GB_COUNT macros expand to nothing and cost nothing. Counters are per
+// thread, so instances on different threads never share cache lines or
+// need atomics; each thread reports its own.
+typedef enum {
+    Region_ROM,
+    Region_VRAM,
+    Region_ERAM,
+    Region_WRAM,
+    Region_Echo,
+    Region_OAM,
+    Region_Unusable,
+    Region_IO,
+    Region_HRAM,
+    Region_IE,
+    Region_Count
+} bus_region;
+
+struct Counters {
+    u64 bus_reads[Region_Count] = {0};
+    u64 bus_writes[Region_Count] = {0};
+    u64 io_reads[0x80] = {0};   // By address, 0xFF00 - 0xFF7F
+    u64 io_writes[0x80] = {0};
+    u64 opcodes[0x100] = {0};
+    u64 cb_opcodes[0x100] = {0};
+    u64 cycles_running = 0;     // M-cycles
+    u64 cycles_halted = 0;
+    u64 interrupts[5] = {0};    // By interrupt_type
+    u64 rom_bank_switches = 0;  // Writes that changed the bank
+    u64 ram_bank_switches = 0;
+    u64 scanlines_rendered = 0;
+    u64 scanlines_skipped = 0;  // Rendering was off (run-ahead, fast forward)
+};
+
+#ifdef GB_COUNTERS
+extern thread_local Counters gb_counters;
+#define GB_COUNT(field) (gb_counters.field++)
+#define GB_COUNT_ADD(field, n) (gb_counters.field += (n))
+#else
+#define GB_COUNT(field) ((void)0)
+#define GB_COUNT_ADD(field, n) ((void)0)
+#endif
+
+bool counters_enabled();
+Counters &thread_counters();   // This thread's
+void reset_counters();
+void print_counters(std::ostream &out, const Counters &c);
+
+#endif
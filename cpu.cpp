@@ -1,9 +1,57 @@
 #include "cpu.h"
+#include "flat_bus.h"
+
+template <typename Bus>
+CpuCore<Bus>::CpuCore(MachineState &state_, Bus &bus_) 
+    : state(state_), bus(bus_), regs(state_.regs), ctx(state_.ctx), 
+      instr_set(regs, ctx, bus), int_handler(state_, bus) {}
+template <typename Bus>
+CpuCore<Bus>::~CpuCore() {}
+
+template <typename Bus>
+bool CpuCore<Bus>::take_breakpoint() {
+    bool hit = breakpoint;
+    breakpoint = false;
+    return hit;
+}
+
+template <typename Bus>
+u64 CpuCore<Bus>::get_instructions() {
+    return instructions;
+}
+
+template <typename Bus>
+void CpuCore<Bus>::set_profiler(Profiler *p) {
+    profiler = p;
+}
 
-CPU::CPU(MemoryBus &bus_) : bus(bus_), instr_set(regs, ctx, bus), int_handler(regs, ctx, bus) {}
-CPU::~CPU() {}
+template <typename Bus>
+void CpuCore<Bus>::set_exec_trace(ExecTrace *t) {
+    exec_trace = t;
+}
+
+template <typename Bus>
+void CpuCore<Bus>::trace_instruction() {
+    ExecRecord rec;
+    rec.cycles = state.cycles;
+    rec.pc = regs.PC;
+    rec.sp = regs.SP;
+    rec.bank = bus.code_bank(regs.PC);
+    rec.a = regs.A;
+    rec.f = regs.F;
+    rec.b = regs.B;
+    rec.c = regs.C;
+    rec.d = regs.D;
+    rec.e = regs.E;
+    rec.h = regs.H;
+    rec.l = regs.L;
+    for (int i = 0; i < 4; i++) rec.pcmem[i] = bus.peek(regs.PC + i);
+    exec_trace->record(rec);
+}
 
-bool CPU::step() {
+template <typename Bus>
+bool CpuCore<Bus>::step() {
+    u64 start_cycles = state.cycles;
 
     if (ctx.IME_next) { // Enable interrupts
         ctx.IME = true;
@@ -11,66 +59,43 @@ bool CPU::step() {
     }
 
     if (ctx.IME) {
+        u16 pc = regs.PC;
         int_handler.handle_interrupts();
+        if (profiler && regs.PC != pc) profiler->interrupt(regs.PC, regs.SP);
     }
     
     if (!ctx.halted) {
 
-        // std::cout << "PC = 0x" << std::hex << std::setw(4) << std::setfill('0') << regs.PC << ":";
-
         // Fetch opcode
+        u16 pc = regs.PC;
+        u16 sp = regs.SP;
+        if (exec_trace) trace_instruction();
         u8 opcode = bus.read(regs.PC++); 
         bus.emulate_cycles(1);
-        // std::cout << " Opcode: 0x" << std::hex << std::setw(2) << std::setfill('0') << +opcode;
-
-        // Debugging flags and registers
-        // char z = BIT(regs.F, 7) ? 'Z' : '-';
-        // char n = BIT(regs.F, 6) ? 'N' : '-';
-        // char h = BIT(regs.F, 5) ? 'H' : '-';
-        // char c = BIT(regs.F, 4) ? 'C' : '-';
-        // std::cout << " Flags set: " << z << n << h << c;
-
-        // std::cout << " AF: 0x" 
-        //     << std::hex << std::setw(2) << std::setfill('0') << +regs.A 
-        //     << std::hex << std::setw(2) << std::setfill('0') << +regs.F;
-        // std::cout << " BC: 0x" 
-        //     << std::hex << std::setw(2) << std::setfill('0') << +regs.B 
-        //     << std::hex << std::setw(2) << std::setfill('0') << +regs.C; 
-        // std::cout << " DE: 0x" 
-        //     << std::hex << std::setw(2) << std::setfill('0') << +regs.D 
-        //     << std::hex << std::setw(2) << std::setfill('0') << +regs.E; 
-        // std::cout << " HL: 0x" 
-        //     << std::hex << std::setw(2) << std::setfill('0') << +regs.H 
-        //     << std::hex << std::setw(2) << std::setfill('0') << +regs.L;  
-        // std::cout << " SP: 0x" 
-        //     << std::hex << std::setw(4) << std::setfill('0') << +regs.SP; 
-
-        // std::cout << std::endl;
-    
+        instructions++;
+
         // Decode and execute opcode
+        GB_COUNT(opcodes[opcode]);
         if (!decode_and_execute(opcode)) {
             std::cout << "CPU could not decode or execute an instruction\n";
             return false;
         }
+        GB_COUNT_ADD(cycles_running, (state.cycles - start_cycles) >> 2);
 
-        // Printing from serial port for blargg tests
-        if (bus.read(0xFF02) == 0x81) {
-            char debug_c = bus.read(0xFF01);
-            debug_msg[debug_msg_size++] = debug_c;
-            bus.write(0xFF02, 0);
+        if (profiler) {
+            profiler->instruction((bus.code_bank(pc) << 16) | pc, opcode, state.cycles - start_cycles,
+                                  sp, regs.SP, (bus.code_bank(regs.PC) << 16) | regs.PC);
         }
-
-        // if (debug_msg[0]) {
-        //     std::cout << "Serial port: " << debug_msg << std::endl;
-        // }
     } else { 
         // CPU is halted
 
         // Let the timer run
         bus.emulate_cycles(1); 
+        GB_COUNT_ADD(cycles_halted, (state.cycles - start_cycles) >> 2);
+        if (profiler) profiler->halted(state.cycles - start_cycles);
 
         // CPU resumes execution if an interrupt is pending
-        if (bus.get_IF() && bus.get_IE()) { 
+        if (state.IF && state.IE) { 
             // std::cout << "Waking up the CPU\n";
             ctx.halted = false;
         } 
@@ -80,7 +105,8 @@ bool CPU::step() {
     return true;
 }
 
-bool CPU::decode_and_execute(u8 opcode) {
+template <typename Bus>
+bool CpuCore<Bus>::decode_and_execute(u8 opcode) {
 
     switch (opcode) {
         
@@ -152,7 +178,7 @@ bool CPU::decode_and_execute(u8 opcode) {
         case 0x3E: instr_set.ld(regs.A);                     break;
         case 0x3F: instr_set.ccf();                          break;
         
-        case 0x40: instr_set.ld(regs.B, regs.B); break;
+        case 0x40: instr_set.ld(regs.B, regs.B); breakpoint = true; break;
         case 0x41: instr_set.ld(regs.B, regs.C); break;
         case 0x42: instr_set.ld(regs.B, regs.D); break;
         case 0x43: instr_set.ld(regs.B, regs.E); break;
@@ -347,6 +373,7 @@ bool CPU::decode_and_execute(u8 opcode) {
         case 0xCB:
             opcode = bus.read(regs.PC++);
             bus.emulate_cycles(1);
+            GB_COUNT(cb_opcodes[opcode]);
             // std::cout << "Encountered prefixed 0xCB code: 0x" 
             //     << std::hex << +opcode << std::endl;
 
@@ -641,4 +668,22 @@ bool CPU::decode_and_execute(u8 opcode) {
 
     return true;
 
-}
\ No newline at end of file
+}
+
+template <typename Bus>
+void CpuCore<Bus>::serialize(SaveState &save) {
+    // Registers are part of the machine state the bus stores
+    bus.serialize(save);
+}
+
+template <typename Bus>
+bool CpuCore<Bus>::deserialize(const SaveState &save) {
+    return bus.deserialize(save);
+}
+
+template class CpuCore<MemoryBus>;
+
+// The flat bus is only ever stepped; there is nothing on it to save
+template CpuCore<FlatBus>::CpuCore(MachineState &state_, FlatBus &bus_);
+template CpuCore<FlatBus>::~CpuCore();
+template bool CpuCore<FlatBus>::step();
@@ -3,25 +3,45 @@
 
 #include "common.h"
 #include "memory.h"
+#include "machine_state.h"
 #include "cpu_util.h"
 #include "instruction_set.h" 
 #include "interrupt_handler.h"
+#include "profiler.h"
+#include "exec_trace.h"
 
-class CPU {
+// The SM83, over MemoryBus in the emulator or FlatBus under gb-sm83.
+// Both are compiled in cpu.cpp, so the real bus pays nothing for the
+// test one.
+template <typename Bus>
+class CpuCore {
     private:
-        MemoryBus &bus;
-        Registers regs;
-        CpuContext ctx;
-        InstructionSet instr_set;
-        InterruptHandler int_handler;
+        MachineState &state;
+        Bus &bus;
+        Registers &regs;
+        CpuContext &ctx;
+        InstructionSet<Bus> instr_set;
+        InterruptHandler<Bus> int_handler;
 
-        char debug_msg[1024] = {0};
-        int debug_msg_size = 0;
+        bool breakpoint = false; // Set by LD B,B, which test ROMs use to signal they're done
+        u64 instructions = 0;    // Executed since power on, for benchmarks
+        Profiler *profiler = nullptr;
+        ExecTrace *exec_trace = nullptr;
+
+        void trace_instruction();
     public:
-        CPU(MemoryBus &bus_);
-        ~CPU();
+        CpuCore(MachineState &state_, Bus &bus_);
+        ~CpuCore();
         bool step();
         bool decode_and_execute(u8 opcode);
+        bool take_breakpoint();
+        u64 get_instructions();
+        void set_profiler(Profiler *p); // nullptr stops profiling
+        void set_exec_trace(ExecTrace *t); // nullptr stops tracing
+        void serialize(SaveState &save);
+        bool deserialize(const SaveState &save);
 };
 
+typedef CpuCore<MemoryBus> CPU;
+
 #endif
\ No newline at end of file
@@ -1,7 +0,0 @@
-#include "cpu_util.h"
-
-Registers::Registers() {}
-Registers::~Registers() {}
-
-CpuContext::CpuContext() {}
-CpuContext::~CpuContext() {}
\ No newline at end of file
@@ -15,16 +15,12 @@ struct Registers {
     u8 L = 0x4D;
     u16 PC = 0x100;
     u16 SP = 0xFFFE;
-    Registers();
-    ~Registers();
 }; 
 
 struct CpuContext {
     bool halted = false;
     bool IME = false;
     bool IME_next = false;
-    CpuContext();
-    ~CpuContext();
 };
 
 #endif
\ No newline at end of file
@@ -0,0 +1,232 @@
+#include "emulator.h"
+
+Emulator::Emulator(bool headless)
+    : timer(state),
+      apu(state),
+      io(state, joypad, timer, apu),
+      event_handler(joypad, io),
+      ppu(state, event_handler, headless),
+      bus(state, cart, io, ppu, timer),
+      cpu(state, bus) {
+    memset(frame, 0, sizeof(frame));
+}
+
+Emulator::~Emulator() {}
+
+bool Emulator::load_rom(const char *path) {
+    if (!cart.load_rom(path)) return false;
+    clear_reset_point();
+    power_cycle();
+    return true;
+}
+
+bool Emulator::load_rom(const u8 *data, u32 size) {
+    if (!cart.load_rom(data, size)) return false;
+    clear_reset_point();
+    power_cycle();
+    return true;
+}
+
+void Emulator::reset() {
+    if (reset_point) load_state(*reset_point);
+    else power_cycle();
+}
+
+void Emulator::power_cycle() {
+    // The APU picks its timeline up from the machine state, so that goes first
+    state = MachineState();
+    joypad.reset();
+    io.reset();
+    apu.reset();
+    ppu.reset();
+    bus.reset();
+    if (profiler) profiler->restart_stack();
+}
+
+void Emulator::set_reset_point() {
+    if (!reset_point) reset_point.reset(new SaveState());
+    save_state(*reset_point);
+}
+
+void Emulator::clear_reset_point() {
+    reset_point.reset();
+}
+
+bool Emulator::warm_start(SnapshotCache &cache, const StartSpec &spec, bool *cached) {
+    std::shared_ptr<RomImage> rom = cart.get_rom();
+    if (!rom) return false;
+
+    SnapshotKey key(rom->get_crc(), rom->get_size(), spec);
+    SnapshotEntry entry;
+    bool hit = cache.fetch(key, entry);
+    if (cached) *cached = hit;
+    if (hit) return load_state(*entry.get());
+
+    // Nothing cached yet: start from power on with empty cartridge RAM
+    cart.clear_ram();
+    power_cycle();
+    for (u64 i = 0; i < spec.frames; i++) {
+        set_joypad(i < spec.inputs.size() ? spec.inputs[i] : 0);
+        if (!run_frame()) return false;
+    }
+    set_joypad(0);
+
+    SaveState save;
+    save_state(save);
+    cache.store(key, save); // A failed store only costs the next job time
+    return true;
+}
+
+bool Emulator::run_frame() {
+    TRACE_ZONE("run_frame");
+
+    // Run until the PPU finishes a frame. The cycle cap stops a switched
+    // off LCD from stalling us and keeps audio in pace with video while
+    // it's off; one line of slack keeps a slightly long frame whole.
+    u64 frame_start = ppu.get_frame_count();
+    u64 end = state.cycles + max_cycles_per_frame;
+    while (state.cycles < end && ppu.get_frame_count() == frame_start) {
+        if (!cpu.step()) return false;
+    }
+    return true;
+}
+
+bool Emulator::run_cycles(u64 cycles) {
+    // Instructions aren't split, so this may overshoot by a few cycles
+    u64 end = state.cycles + cycles;
+    while (state.cycles < end) {
+        if (!cpu.step()) return false;
+    }
+    return true;
+}
+
+void Emulator::set_joypad(u8 pressed) {
+    for (int i = Dpad_Up; i <= Button_Select; i++) {
+        joypad.update((joypad_button)i, BIT(pressed, i));
+    }
+}
+
+u8 Emulator::get_joypad() {
+    return joypad.get_pressed();
+}
+
+const u8 *Emulator::framebuffer() {
+    ppu.get_frame(frame);
+    return frame;
+}
+
+u64 Emulator::frame_hash() {
+    // Hashes the colour IDs as they are, seeded with what they map to,
+    // instead of converting every pixel to a shade first
+    u8 map[None_Transparent + 1];
+    ppu.get_shade_map(map);
+    return xxh64(ppu.get_lcd_buf(), 144 * 160, xxh64(map, sizeof(map)));
+}
+
+const std::string &Emulator::serial_output() {
+    return io.get_serial();
+}
+
+bool Emulator::take_breakpoint() {
+    return cpu.take_breakpoint();
+}
+
+bool Emulator::save_screenshot(const char *path) {
+    std::ofstream ofs;
+    ofs.open(path, std::ios::binary);
+    if (ofs.fail()) {
+        std::cout << "Screenshot failed to be created\n";
+        return false;
+    }
+
+    // Binary PPM: a short text header, then RGB triples
+    const u8 *shades = framebuffer();
+    u8 rgb[144 * 160 * 3];
+    for (int i = 0; i < 144 * 160; i++) memcpy(rgb + 3 * i, PPU::palette[shades[i]], 3);
+    ofs << "P6\n160 144\n255\n";
+    ofs.write((char*)rgb, sizeof(rgb));
+    ofs.close();
+
+    return !ofs.fail();
+}
+
+void Emulator::observe(const ObsSpec &spec, u8 *out) {
+    u8 map[None_Transparent + 1];
+    ppu.get_shade_map(map);
+    make_observation(ppu.get_lcd_buf(), map, spec, out);
+}
+
+u8 Emulator::peek(u16 addr) {
+    return bus.peek(addr);
+}
+
+void Emulator::save_state(SaveState &save) {
+    cpu.serialize(save);
+}
+
+bool Emulator::load_state(const SaveState &save) {
+    if (profiler) profiler->restart_stack();
+    return cpu.deserialize(save);
+}
+
+bool Emulator::fork_into(Emulator &child) {
+    if (&child == this || !cart.get_rom()) return false;
+
+    if (child.cart.get_rom() != cart.get_rom()) child.cart.share_rom(cart);
+
+    // Staged in the child, which is overwritten anyway; keeps a big
+    // state off the stack and lets reused children fork without allocating
+    if (!child.fork_save) child.fork_save.reset(new SaveState());
+    save_state(*child.fork_save);
+    return child.load_state(*child.fork_save);
+}
+
+Emulator *Emulator::fork() {
+    Emulator *child = new Emulator();
+    if (!fork_into(*child)) {
+        delete child;
+        return nullptr;
+    }
+    return child;
+}
+
+u64 Emulator::get_frame_count() {
+    return ppu.get_frame_count();
+}
+
+u64 Emulator::get_cycles() {
+    return state.cycles;
+}
+
+void Emulator::set_profiler(Profiler *p) {
+    profiler = p;
+    cpu.set_profiler(p);
+}
+
+void Emulator::set_exec_trace(ExecTrace *t) {
+    cpu.set_exec_trace(t);
+}
+
+u64 Emulator::get_instructions() {
+    return cpu.get_instructions();
+}
+
+Registers Emulator::get_registers() {
+    return state.regs;
+}
+
+Cartridge &Emulator::get_cart() {
+    return cart;
+}
+
+APU &Emulator::get_apu() {
+    return apu;
+}
+
+PPU &Emulator::get_ppu() {
+    return ppu;
+}
+
+EventHandler &Emulator::get_event_handler() {
+    return event_handler;
+}
@@ -0,0 +1,92 @@
+#ifndef EMULATOR_H
+#define EMULATOR_H
+
+#include "common.h"
+#include "memory.h"
+#include "cpu.h"
+#include "observation.h"
+#include "snapshot_cache.h"
+#include <memory>
+
+// One complete Game Boy, wired up and owned in one place.
+//
+// Everything lives inside the instance and nothing is global, so any
+// number of them can run side by side in one process. Headless instances
+// (the default) never touch SDL video.
+class Emulator {
+    private:
+        // Declared in the order they have to be built in
+        MachineState state;
+        Cartridge cart;
+        Joypad joypad;
+        Timer timer;
+        APU apu;
+        IO io;
+        EventHandler event_handler;
+        PPU ppu;
+        MemoryBus bus;
+        CPU cpu;
+
+        u8 frame[144 * 160]; // Shades handed out by framebuffer()
+        std::unique_ptr<SaveState> reset_point; // Where reset() goes, if set
+        std::unique_ptr<SaveState> fork_save;   // Staging for forks into us
+        Profiler *profiler = nullptr;
+
+        void power_cycle();
+    public:
+        static const int max_cycles_per_frame = 70224 + 456;
+
+        Emulator(bool headless = true);
+        ~Emulator();
+        bool load_rom(const char *path);
+        bool load_rom(const u8 *data, u32 size);
+
+        // Restarts the game in place: no SDL setup, no ROM reload. Without
+        // a reset point every component goes back to its power-on state
+        // and battery-backed RAM survives, as on a real console; with one,
+        // the whole machine is restored to it instead.
+        void reset();
+        void set_reset_point(); // Current state becomes the reset point
+        void clear_reset_point();
+
+        // Resumes from the state spec leads to after power on, mapped from
+        // the cache when it is there. Otherwise it is emulated from a fresh
+        // cartridge and stored for next time. The reset point is untouched.
+        // cached, if given, says which of the two happened.
+        bool warm_start(SnapshotCache &cache, const StartSpec &spec, bool *cached = nullptr);
+
+        // Branches this machine off into child, which then runs on its own.
+        // The ROM is shared; RAM, video memory, SRAM and registers are
+        // copied. Reusing children skips construction and makes a fork
+        // just that copy. Children keep their own reset point and settings.
+        bool fork_into(Emulator &child);
+        Emulator *fork(); // New headless child, or nullptr
+
+        bool run_frame();
+        bool run_cycles(u64 cycles);
+        void set_joypad(u8 pressed); // Bit n set holds joypad_button n
+        u8 get_joypad();
+        const u8 *framebuffer();     // 160x144 shades (0-3), row by row
+        u64 frame_hash();            // xxh64 of the picture, cheap enough for every frame
+        const std::string &serial_output(); // Bytes sent over the link port since the last reset
+        bool take_breakpoint();      // Whether LD B,B ran since the last call
+        bool save_screenshot(const char *path);
+        void observe(const ObsSpec &spec, u8 *out);
+        u8 peek(u16 addr);
+
+        void save_state(SaveState &save);
+        bool load_state(const SaveState &save);
+
+        u64 get_frame_count();
+        u64 get_cycles();
+        u64 get_instructions();
+        void set_profiler(Profiler *p); // Not owned; nullptr stops profiling
+        void set_exec_trace(ExecTrace *t); // Not owned; nullptr stops tracing
+        Registers get_registers();
+        Cartridge &get_cart();
+        APU &get_apu();
+        PPU &get_ppu();
+        EventHandler &get_event_handler();
+};
+
+#endif
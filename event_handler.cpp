@@ -4,7 +4,13 @@ EventHandler::EventHandler(Joypad &joypad_, IO &io_)
 : joypad(joypad_), io(io_) {}
 EventHandler::~EventHandler() {}
 
+void EventHandler::set_button(joypad_button button, bool pressed) {
+    if (pressed) held |= 1 << button;
+    else held &= ~(1 << button);
+}
+
 void EventHandler::handle_events() {
+    TRACE_ZONE("handle_events");
     SDL_Event event;
     while (SDL_PollEvent(&event)) {
         switch (event.type) {
@@ -16,29 +22,41 @@ void EventHandler::handle_events() {
                     case SDL_SCANCODE_ESCAPE:
                         quit = true;
                         break;
+                    case SDL_SCANCODE_F5:
+                        save_state = true;
+                        break;
+                    case SDL_SCANCODE_F8:
+                        load_state = true;
+                        break;
+                    case SDL_SCANCODE_F1:
+                        reset = true;
+                        break;
+                    case SDL_SCANCODE_BACKSPACE:
+                        rewind = true;
+                        break;
                     case SDL_SCANCODE_UP:
-                        joypad.update(Dpad_Up, true);
+                        set_button(Dpad_Up, true);
                         break;
                     case SDL_SCANCODE_DOWN:
-                        joypad.update(Dpad_Down, true);
+                        set_button(Dpad_Down, true);
                         break;
                     case SDL_SCANCODE_LEFT:
-                        joypad.update(Dpad_Left, true);
+                        set_button(Dpad_Left, true);
                         break;
                     case SDL_SCANCODE_RIGHT:
-                        joypad.update(Dpad_Right, true);
+                        set_button(Dpad_Right, true);
                         break;
                     case SDL_SCANCODE_S:
-                        joypad.update(Button_A, true);
+                        set_button(Button_A, true);
                         break;
                     case SDL_SCANCODE_A:
-                        joypad.update(Button_B, true);
+                        set_button(Button_B, true);
                         break;
                     case SDL_SCANCODE_RETURN:
-                        joypad.update(Button_Start, true);
+                        set_button(Button_Start, true);
                         break;
                     case SDL_SCANCODE_RSHIFT:
-                        joypad.update(Button_Select, true);
+                        set_button(Button_Select, true);
                         break;
                     default: break;
                 } 
@@ -46,28 +64,31 @@ void EventHandler::handle_events() {
             case (SDL_KEYUP):
                 switch (event.key.keysym.scancode) {
                     case SDL_SCANCODE_UP:
-                        joypad.update(Dpad_Up, false);
+                        set_button(Dpad_Up, false);
                         break;
                     case SDL_SCANCODE_DOWN:
-                        joypad.update(Dpad_Down, false);
+                        set_button(Dpad_Down, false);
                         break;
                     case SDL_SCANCODE_LEFT:
-                        joypad.update(Dpad_Left, false);
+                        set_button(Dpad_Left, false);
                         break;
                     case SDL_SCANCODE_RIGHT:
-                        joypad.update(Dpad_Right, false);
+                        set_button(Dpad_Right, false);
                         break;
                     case SDL_SCANCODE_S:
-                        joypad.update(Button_A, false);
+                        set_button(Button_A, false);
                         break;
                     case SDL_SCANCODE_A:
-                        joypad.update(Button_B, false);
+                        set_button(Button_B, false);
                         break;
                     case SDL_SCANCODE_RETURN:
-                        joypad.update(Button_Start, false);
+                        set_button(Button_Start, false);
                         break;
                     case SDL_SCANCODE_RSHIFT:
-                        joypad.update(Button_Select, false);
+                        set_button(Button_Select, false);
+                        break;
+                    case SDL_SCANCODE_BACKSPACE:
+                        rewind = false;
                         break;
                     default: break;
                 } 
@@ -78,4 +99,31 @@ void EventHandler::handle_events() {
 
 bool EventHandler::quit_requested() {
     return quit;
+}
+
+// Requests are consumed once they have been read
+bool EventHandler::save_state_requested() {
+    bool requested = save_state;
+    save_state = false;
+    return requested;
+}
+
+bool EventHandler::load_state_requested() {
+    bool requested = load_state;
+    load_state = false;
+    return requested;
+}
+
+bool EventHandler::reset_requested() {
+    bool requested = reset;
+    reset = false;
+    return requested;
+}
+
+bool EventHandler::rewind_held() {
+    return rewind;
+}
+
+u8 EventHandler::get_held() {
+    return held;
 }
\ No newline at end of file
@@ -4,18 +4,31 @@
 #include "common.h"
 #include "joypad.h"
 #include "io.h"
+#include "trace.h"
 #include "SDL.h"
 
 class EventHandler {
     private:
         bool quit = false;
+        bool save_state = false;
+        bool load_state = false;
+        bool reset = false;
+        bool rewind = false;
+        u8 held = 0; // Keys down, bit n for joypad_button n
         Joypad &joypad;
         IO &io;
+
+        void set_button(joypad_button button, bool pressed);
     public:
         EventHandler(Joypad &joypad_, IO &io_);
         ~EventHandler();
         void handle_events();
         bool quit_requested();
+        bool save_state_requested();
+        bool load_state_requested();
+        bool reset_requested();
+        bool rewind_held();
+        u8 get_held(); // Bit n set while joypad_button n is held
 };
 
 #endif 
\ No newline at end of file
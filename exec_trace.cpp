@@ -0,0 +1,188 @@
+#include "exec_trace.h"
+#include <chrono>
+
+const u32 EXEC_TRACE_MAGIC = 0x54584247; // "GBXT"
+const u32 EXEC_TRACE_VERSION = 1;
+
+// Which fields follow the cycle delta in an encoded record
+enum {
+    Changed_PC = 1 << 0,
+    Changed_SP = 1 << 1,
+    Changed_Bank = 1 << 2,
+    Changed_A = 1 << 3,      // A to L are one bit each, in order
+    Changed_PCMem = 1 << 11
+};
+
+// A to L, in the order of their Changed_ bits
+u8 ExecRecord::*const reg_fields[8] = {
+    &ExecRecord::a, &ExecRecord::f, &ExecRecord::b, &ExecRecord::c,
+    &ExecRecord::d, &ExecRecord::e, &ExecRecord::h, &ExecRecord::l
+};
+
+const int max_encoded = 32; // Bytes one record can take
+
+u8 *put_varint(u8 *out, u64 n) {
+    for (; n >= 0x80; n >>= 7) *out++ = (n & 0x7F) | 0x80;
+    *out++ = n;
+    return out;
+}
+
+bool get_varint(std::ifstream &in, u64 &n) {
+    n = 0;
+    for (int shift = 0; shift < 64; shift += 7) {
+        int byte = in.get();
+        if (byte == EOF) return false;
+        n |= (u64)(byte & 0x7F) << shift;
+        if (!(byte & 0x80)) return true;
+    }
+    return false;
+}
+
+u16 get_u16(std::ifstream &in) {
+    u8 lo = in.get();
+    u8 hi = in.get();
+    return lo | (hi << 8);
+}
+
+// Writes rec as its changes from prev, returns the end
+u8 *encode(const ExecRecord &rec, ExecRecord &prev, u8 *out) {
+    u16 mask = 0;
+    if (rec.pc != prev.pc) mask |= Changed_PC;
+    if (rec.sp != prev.sp) mask |= Changed_SP;
+    if (rec.bank != prev.bank) mask |= Changed_Bank;
+    for (int i = 0; i < 8; i++) {
+        if (rec.*reg_fields[i] != prev.*reg_fields[i]) mask |= Changed_A << i;
+    }
+    if (memcmp(rec.pcmem, prev.pcmem, 4)) mask |= Changed_PCMem;
+
+    *out++ = mask & 0xFF;
+    *out++ = mask >> 8;
+    out = put_varint(out, rec.cycles - prev.cycles);
+    if (mask & Changed_PC) {
+        // Mostly a short hop forward; zigzag keeps small jumps back small
+        int16_t delta = (int16_t)(rec.pc - prev.pc);
+        out = put_varint(out, (u16)((delta * 2) ^ (delta >> 15)));
+    }
+    if (mask & Changed_SP) {
+        *out++ = rec.sp & 0xFF;
+        *out++ = rec.sp >> 8;
+    }
+    if (mask & Changed_Bank) {
+        *out++ = rec.bank & 0xFF;
+        *out++ = rec.bank >> 8;
+    }
+    for (int i = 0; i < 8; i++) {
+        if (mask & (Changed_A << i)) *out++ = rec.*reg_fields[i];
+    }
+    if (mask & Changed_PCMem) {
+        memcpy(out, rec.pcmem, 4);
+        out += 4;
+    }
+    prev = rec;
+    return out;
+}
+
+ExecTrace::ExecTrace() : ring(new ExecRecord[ring_size]) {}
+
+ExecTrace::~ExecTrace() {
+    close();
+}
+
+bool ExecTrace::open(const char *path) {
+    close();
+    out.open(path, std::ios::binary);
+    if (out.fail()) {
+        std::cout << "Trace file failed to be created\n";
+        return false;
+    }
+    u32 header[2] = {EXEC_TRACE_MAGIC, EXEC_TRACE_VERSION};
+    out.write((char*)header, sizeof(header));
+
+    head = 0;
+    tail = 0;
+    tail_seen = 0;
+    written = 0;
+    stopping = false;
+    writer = std::thread(&ExecTrace::drain, this);
+    return true;
+}
+
+void ExecTrace::close() {
+    if (!writer.joinable()) return;
+    stopping.store(true, std::memory_order_release);
+    writer.join();
+    out.close();
+    if (out.fail()) std::cout << "Trace file could not be written\n";
+}
+
+u64 ExecTrace::get_written() {
+    return written;
+}
+
+void ExecTrace::drain() {
+    ExecRecord prev = {};
+    std::unique_ptr<u8[]> buf(new u8[(size_t)ring_size * max_encoded]);
+    u64 t = 0;
+    while (true) {
+        // Stopping is read first, so the head after it is the final one
+        bool stop = stopping.load(std::memory_order_acquire);
+        u64 h = head.load(std::memory_order_acquire);
+        if (t == h) {
+            if (stop) break;
+            std::this_thread::sleep_for(std::chrono::microseconds(200));
+            continue;
+        }
+
+        written += h - t;
+        u8 *end = buf.get();
+        for (; t < h; t++) end = encode(ring[t & (ring_size - 1)], prev, end);
+        tail.store(t, std::memory_order_release);
+        out.write((char*)buf.get(), end - buf.get());
+    }
+}
+
+ExecTraceReader::ExecTraceReader() {}
+
+ExecTraceReader::~ExecTraceReader() {}
+
+bool ExecTraceReader::open(const char *path) {
+    in.open(path, std::ios::binary);
+    if (in.fail()) {
+        std::cout << "Trace file failed to open\n";
+        return false;
+    }
+    u32 header[2];
+    in.read((char*)header, sizeof(header));
+    if (!in || header[0] != EXEC_TRACE_MAGIC || header[1] != EXEC_TRACE_VERSION) {
+        std::cout << "Trace file is not an execution trace\n";
+        return false;
+    }
+    prev = ExecRecord();
+    return true;
+}
+
+bool ExecTraceReader::next(ExecRecord &rec) {
+    int lo = in.get();
+    int hi = in.get();
+    if (lo == EOF || hi == EOF) return false;
+    u16 mask = lo | (hi << 8);
+
+    rec = prev;
+    u64 delta;
+    if (!get_varint(in, delta)) return false;
+    rec.cycles += delta;
+    if (mask & Changed_PC) {
+        if (!get_varint(in, delta)) return false;
+        rec.pc += (u16)((delta >> 1) ^ -(delta & 1));
+    }
+    if (mask & Changed_SP) rec.sp = get_u16(in);
+    if (mask & Changed_Bank) rec.bank = get_u16(in);
+    for (int i = 0; i < 8; i++) {
+        if (mask & (Changed_A << i)) rec.*reg_fields[i] = in.get();
+    }
+    if (mask & Changed_PCMem) in.read((char*)rec.pcmem, 4);
+    if (!in) return false;
+
+    prev = rec;
+    return true;
+}
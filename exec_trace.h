@@ -0,0 +1,71 @@
+#ifndef EXEC_TRACE_H
+#define EXEC_TRACE_H
+
+#include "common.h"
+#include "cpu_util.h"
+#include <atomic>
+#include <thread>
+#include <memory>
+
+// CPU state before every instruction, written to a file as it runs.
+//
+// The CPU fills fixed-size records into a single-producer ring and
+// carries on; a writer thread drains it, stores each record as the
+// fields that changed since the one before (the cycle count and PC as
+// varint deltas) and writes that out. A full ring makes the CPU wait
+// rather than drop anything, so traces are complete. ExecTraceReader
+// gets the records back, e.g. for gb-trace to print them as a
+// gameboy-doctor log.
+struct ExecRecord {
+    u64 cycles;   // T-cycles since power on
+    u16 pc;
+    u16 sp;
+    u16 bank;     // ROM bank at 0x4000 - 0x7FFF when PC is there, else 0
+    u8 a, f, b, c, d, e, h, l;
+    u8 pcmem[4];  // Memory at PC, opcode first
+};
+
+class ExecTrace {
+    private:
+        static const u32 ring_size = 1 << 16; // Records
+
+        std::unique_ptr<ExecRecord[]> ring;
+        std::atomic<u64> head{0}; // Written by the CPU
+        std::atomic<u64> tail{0}; // Written by the writer thread
+        u64 tail_seen = 0;        // CPU's last look at tail, to skip the atomic load
+        std::atomic<bool> stopping{false};
+        std::thread writer;
+        std::ofstream out;
+        u64 written = 0;
+
+        void drain();
+    public:
+        ExecTrace();
+        ~ExecTrace();   // Writes out everything recorded
+        bool open(const char *path);
+        void close();
+        u64 get_written(); // Records, once closed
+
+        inline void record(const ExecRecord &rec) {
+            u64 h = head.load(std::memory_order_relaxed);
+            if (h - tail_seen >= ring_size) {
+                // Full: wait for the writer to catch up
+                while (h - (tail_seen = tail.load(std::memory_order_acquire)) >= ring_size) std::this_thread::yield();
+            }
+            ring[h & (ring_size - 1)] = rec;
+            head.store(h + 1, std::memory_order_release);
+        }
+};
+
+class ExecTraceReader {
+    private:
+        std::ifstream in;
+        ExecRecord prev;
+    public:
+        ExecTraceReader();
+        ~ExecTraceReader();
+        bool open(const char *path);
+        bool next(ExecRecord &rec); // false at the end
+};
+
+#endif
@@ -0,0 +1,27 @@
+#include "flat_bus.h"
+
+FlatBus::FlatBus(MachineState &state_, u8 *mem_, std::vector<BusAccess> &log_)
+    : state(state_), mem(mem_), log(log_) {}
+FlatBus::~FlatBus() {}
+
+u8 FlatBus::read(u16 addr) {
+    log.push_back({(u32)(state.cycles >> 2), addr, mem[addr], false});
+    return mem[addr];
+}
+
+void FlatBus::write(u16 addr, u8 val) {
+    log.push_back({(u32)(state.cycles >> 2), addr, val, true});
+    mem[addr] = val;
+}
+
+u8 FlatBus::peek(u16 addr) {
+    return mem[addr];
+}
+
+void FlatBus::emulate_cycles(int cpu_cycles) {
+    state.cycles += 4 * cpu_cycles;
+}
+
+u16 FlatBus::code_bank(u16 addr) {
+    return 0;
+}
@@ -0,0 +1,33 @@
+#ifndef FLAT_BUS_H
+#define FLAT_BUS_H
+
+#include "common.h"
+#include "machine_state.h"
+#include <vector>
+
+// One access made on a FlatBus
+struct BusAccess {
+    u32 cycle; // M-cycle it happened in, counted from 0 when cycles was 0
+    u16 addr;
+    u8 val;
+    bool write;
+};
+
+// Stands in for MemoryBus under the single-step CPU tests: all 64 KB are
+// plain memory, nothing else ticks, and every access is logged.
+class FlatBus {
+    private:
+        MachineState &state;
+        u8 *mem;
+        std::vector<BusAccess> &log;
+    public:
+        FlatBus(MachineState &state_, u8 *mem_, std::vector<BusAccess> &log_);
+        ~FlatBus();
+        u8 read(u16 addr);
+        void write(u16 addr, u8 val);
+        u8 peek(u16 addr);       // Not logged
+        void emulate_cycles(int cpu_cycles);
+        u16 code_bank(u16 addr); // Nothing is banked
+};
+
+#endif
@@ -0,0 +1,213 @@
+#include "gbemu.h"
+#include "emulator.h"
+#include "vec_env.h"
+
+struct gb_emu {
+    Emulator emu;
+    SaveState save; // Scratch space, kept here to stay off the caller's stack
+};
+
+gb_emu *gb_create(void) {
+    // Errors must not cross the C boundary
+    try {
+        return new gb_emu;
+    } catch (...) {
+        return nullptr;
+    }
+}
+
+void gb_destroy(gb_emu *gb) {
+    delete gb;
+}
+
+int gb_load_rom_file(gb_emu *gb, const char *path) {
+    try {
+        return gb->emu.load_rom(path);
+    } catch (...) {
+        return 0;
+    }
+}
+
+int gb_load_rom_memory(gb_emu *gb, const uint8_t *data, size_t size) {
+    if (size > 0xFFFFFFFF) return 0;
+    try {
+        return gb->emu.load_rom(data, (u32)size);
+    } catch (...) {
+        return 0;
+    }
+}
+
+void gb_reset(gb_emu *gb) {
+    gb->emu.reset();
+}
+
+void gb_set_reset_point(gb_emu *gb) {
+    try {
+        gb->emu.set_reset_point();
+    } catch (...) {}
+}
+
+void gb_clear_reset_point(gb_emu *gb) {
+    gb->emu.clear_reset_point();
+}
+
+int gb_warm_start(gb_emu *gb, const char *cache_dir, uint64_t frames,
+                  const uint8_t *inputs, size_t input_count) {
+    try {
+        SnapshotCache cache(cache_dir);
+        StartSpec spec;
+        spec.frames = frames;
+        if (inputs) spec.inputs.assign(inputs, inputs + input_count);
+        return gb->emu.warm_start(cache, spec);
+    } catch (...) {
+        return 0;
+    }
+}
+
+gb_emu *gb_fork(gb_emu *gb) {
+    gb_emu *child = gb_create();
+    if (child && !gb_fork_into(gb, child)) {
+        gb_destroy(child);
+        return nullptr;
+    }
+    return child;
+}
+
+int gb_fork_into(gb_emu *gb, gb_emu *child) {
+    try {
+        return gb->emu.fork_into(child->emu);
+    } catch (...) {
+        return 0;
+    }
+}
+
+int gb_run_frame(gb_emu *gb) {
+    try {
+        return gb->emu.run_frame();
+    } catch (...) {
+        return 0;
+    }
+}
+
+int gb_run_cycles(gb_emu *gb, uint64_t cycles) {
+    try {
+        return gb->emu.run_cycles(cycles);
+    } catch (...) {
+        return 0;
+    }
+}
+
+void gb_set_joypad(gb_emu *gb, uint8_t pressed) {
+    gb->emu.set_joypad(pressed);
+}
+
+const uint8_t *gb_framebuffer(gb_emu *gb) {
+    return gb->emu.framebuffer();
+}
+
+uint64_t gb_frame_count(gb_emu *gb) {
+    return gb->emu.get_frame_count();
+}
+
+size_t gb_state_size(void) {
+    return sizeof(SaveState);
+}
+
+int gb_save_state(gb_emu *gb, void *buf, size_t size) {
+    if (size < sizeof(SaveState)) return 0;
+    gb->emu.save_state(gb->save);
+    memcpy(buf, &gb->save, sizeof(SaveState));
+    return 1;
+}
+
+int gb_load_state(gb_emu *gb, const void *buf, size_t size) {
+    if (size < sizeof(SaveState)) return 0;
+
+    // Copy first: the blob may not be aligned for SaveState
+    memcpy(&gb->save, buf, sizeof(SaveState));
+    if (!gb->save.valid()) return 0;
+    return gb->emu.load_state(gb->save);
+}
+
+struct gb_vec {
+    VecEnv env;
+    gb_vec(int count, int threads) : env(count, threads) {}
+};
+
+gb_vec *gb_vec_create(int count, int threads) {
+    if (count <= 0) return nullptr;
+    try {
+        return new gb_vec(count, threads);
+    } catch (...) {
+        return nullptr;
+    }
+}
+
+void gb_vec_destroy(gb_vec *vec) {
+    delete vec;
+}
+
+int gb_vec_load_rom_file(gb_vec *vec, const char *path) {
+    try {
+        return vec->env.load_rom(path);
+    } catch (...) {
+        return 0;
+    }
+}
+
+int gb_vec_load_rom_memory(gb_vec *vec, const uint8_t *data, size_t size) {
+    if (size > 0xFFFFFFFF) return 0;
+    try {
+        return vec->env.load_rom(data, (u32)size);
+    } catch (...) {
+        return 0;
+    }
+}
+
+void gb_vec_set_observation(gb_vec *vec, int width, int height, int format, int filter) {
+    ObsSpec spec;
+    spec.width = width;
+    spec.height = height;
+    spec.format = (obs_format)std::max(0, std::min(format, (int)Obs_RGB));
+    spec.filter = (obs_filter)std::max(0, std::min(filter, (int)Obs_Max));
+    try {
+        vec->env.set_observation(spec);
+    } catch (...) {}
+}
+
+void gb_vec_set_ram_watch(gb_vec *vec, const uint16_t *addrs, int count) {
+    try {
+        vec->env.set_ram_watch(addrs, count);
+    } catch (...) {}
+}
+
+void gb_vec_set_reset_point(gb_vec *vec) {
+    try {
+        vec->env.set_reset_point();
+    } catch (...) {}
+}
+
+int gb_vec_reset(gb_vec *vec, uint8_t *obs, uint8_t *ram) {
+    try {
+        return vec->env.reset(obs, ram);
+    } catch (...) {
+        return 0;
+    }
+}
+
+int gb_vec_reset_one(gb_vec *vec, int index, uint8_t *obs, uint8_t *ram) {
+    if (index < 0 || index >= vec->env.size()) return 0;
+    try {
+        return vec->env.reset_one(index, obs, ram);
+    } catch (...) {
+        return 0;
+    }
+}
+
+int gb_vec_step(gb_vec *vec, const uint8_t *actions, int frameskip, uint8_t *obs, uint8_t *ram) {
+    try {
+        return vec->env.step(actions, frameskip, obs, ram);
+    } catch (...) {
+        return 0;
+    }
+}
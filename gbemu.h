@@ -0,0 +1,109 @@
+#ifndef GBEMU_H
+#define GBEMU_H
+
+// Plain C interface to libgbemu, for use over FFI.
+//
+// Every call takes the instance it acts on; there is no global state, so
+// separate instances may be driven from separate threads. Functions that
+// can fail return 1 on success and 0 on failure.
+
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef struct gb_emu gb_emu;
+
+// Joypad bits for gb_set_joypad
+enum {
+    GB_UP = 1 << 0,
+    GB_DOWN = 1 << 1,
+    GB_LEFT = 1 << 2,
+    GB_RIGHT = 1 << 3,
+    GB_A = 1 << 4,
+    GB_B = 1 << 5,
+    GB_START = 1 << 6,
+    GB_SELECT = 1 << 7
+};
+
+#define GB_SCREEN_WIDTH 160
+#define GB_SCREEN_HEIGHT 144
+
+gb_emu *gb_create(void);
+void gb_destroy(gb_emu *gb);
+
+int gb_load_rom_file(gb_emu *gb, const char *path);
+int gb_load_rom_memory(gb_emu *gb, const uint8_t *data, size_t size);
+
+// Restarts the loaded game in place. Without a reset point this is a power
+// cycle that keeps battery-backed RAM; with one, that state is restored.
+void gb_reset(gb_emu *gb);
+void gb_set_reset_point(gb_emu *gb);
+void gb_clear_reset_point(gb_emu *gb);
+
+// Puts gb where frames frames of inputs (one joypad mask per frame, NULL
+// or short for none) lead to after power on. The state is cached under
+// cache_dir, so only the first call for a given ROM and start emulates.
+int gb_warm_start(gb_emu *gb, const char *cache_dir, uint64_t frames,
+                  const uint8_t *inputs, size_t input_count);
+
+// Copies gb, ROM shared, into a new instance or an existing child of the
+// same game. Reusing children makes a fork little more than a memcpy.
+gb_emu *gb_fork(gb_emu *gb);
+int gb_fork_into(gb_emu *gb, gb_emu *child);
+
+int gb_run_frame(gb_emu *gb);
+int gb_run_cycles(gb_emu *gb, uint64_t cycles);
+void gb_set_joypad(gb_emu *gb, uint8_t pressed);
+
+// 160x144 shades from 0 (lightest) to 3, valid until the next call on gb
+const uint8_t *gb_framebuffer(gb_emu *gb);
+uint64_t gb_frame_count(gb_emu *gb);
+
+// Save states are opaque blobs of gb_state_size() bytes
+size_t gb_state_size(void);
+int gb_save_state(gb_emu *gb, void *buf, size_t size);
+int gb_load_state(gb_emu *gb, const void *buf, size_t size);
+
+// Vectors of instances stepped together across threads. Observations for
+// all instances go into contiguous buffers the caller owns: frames as
+// uint8_t[count][height][width][channels] and watched bytes as
+// uint8_t[count][n]. Either buffer may be NULL to skip it.
+typedef struct gb_vec gb_vec;
+
+gb_vec *gb_vec_create(int count, int threads); // threads 0 uses every core
+void gb_vec_destroy(gb_vec *vec);
+int gb_vec_load_rom_file(gb_vec *vec, const char *path);
+int gb_vec_load_rom_memory(gb_vec *vec, const uint8_t *data, size_t size);
+
+// Observation formats and scaling filters for gb_vec_set_observation
+enum {
+    GB_OBS_SHADES = 0, // 0 (lightest) to 3
+    GB_OBS_GRAY = 1,   // 255 (lightest) to 0
+    GB_OBS_RGB = 2     // 3 channels
+};
+enum {
+    GB_FILTER_NEAREST = 0,
+    GB_FILTER_BOX = 1, // Average of the covered pixels
+    GB_FILTER_MAX = 2  // Largest covered value
+};
+
+// Frames are scaled down to width x height (at most 160x144)
+void gb_vec_set_observation(gb_vec *vec, int width, int height, int format, int filter);
+void gb_vec_set_ram_watch(gb_vec *vec, const uint16_t *addrs, int count);
+
+// Episodes start right after the ROM loads, or from the states set here
+void gb_vec_set_reset_point(gb_vec *vec);
+int gb_vec_reset(gb_vec *vec, uint8_t *obs, uint8_t *ram);
+int gb_vec_reset_one(gb_vec *vec, int index, uint8_t *obs, uint8_t *ram);
+
+// actions holds one gb_set_joypad mask per instance, held for frameskip frames
+int gb_vec_step(gb_vec *vec, const uint8_t *actions, int frameskip, uint8_t *obs, uint8_t *ram);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
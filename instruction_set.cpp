@@ -1,11 +1,15 @@
 #include "instruction_set.h"
+#include "flat_bus.h"
 
-InstructionSet::InstructionSet(
-    Registers &regs_, CpuContext &ctx_, MemoryBus &bus_
+template <typename Bus>
+InstructionSet<Bus>::InstructionSet(
+    Registers &regs_, CpuContext &ctx_, Bus &bus_
 ) : regs(regs_), ctx(ctx_), bus(bus_) {}
-InstructionSet::~InstructionSet() {}
+template <typename Bus>
+InstructionSet<Bus>::~InstructionSet() {}
 
-u8 InstructionSet::get_n8() {
+template <typename Bus>
+u8 InstructionSet<Bus>::get_n8() {
 
     // Data is immediately after opcode
     u8 n8 = bus.read(regs.PC++); 
@@ -14,7 +18,8 @@ u8 InstructionSet::get_n8() {
     return n8;
 }
 
-u16 InstructionSet::get_n16() {
+template <typename Bus>
+u16 InstructionSet<Bus>::get_n16() {
     
     // Data is immediately after opcode
     u16 lo = bus.read(regs.PC++);
@@ -26,13 +31,16 @@ u16 InstructionSet::get_n16() {
     return n16;
 }
 
-void InstructionSet::nop() {} // Do nothing
+template <typename Bus>
+void InstructionSet<Bus>::nop() {} // Do nothing
 
-void InstructionSet::stop() {
+template <typename Bus>
+void InstructionSet<Bus>::stop() {
     std::cout << "STOPPING" << std::endl;
 }
 
-void InstructionSet::daa() {
+template <typename Bus>
+void InstructionSet<Bus>::daa() {
     // https://github.com/rockytriton/LLD_gbemu/blob/e6be3433526a96401f7d42b653b37ab6a955415d/part10/lib/cpu_proc.c#L201
     
     // As opposed to https://rgbds.gbdev.io/docs/v0.9.1/gbz80.7#DAA, the C flag does NOT reset by DAA
@@ -55,33 +63,39 @@ void InstructionSet::daa() {
 
 }
 
-void InstructionSet::ld(u8 &reg1, u8 reg2) {
+template <typename Bus>
+void InstructionSet<Bus>::ld(u8 &reg1, u8 reg2) {
     reg1 = reg2;
 }
 
-void InstructionSet::ld(u8 &reg) {
+template <typename Bus>
+void InstructionSet<Bus>::ld(u8 &reg) {
     reg = get_n8();
 }
 
-void InstructionSet::ld16(u8 &hi_reg, u8 &lo_reg) {
+template <typename Bus>
+void InstructionSet<Bus>::ld16(u8 &hi_reg, u8 &lo_reg) {
     u16 n16 = get_n16();
 
     lo_reg = n16 & 0xFF;
     hi_reg = (n16 >> 8) & 0xFF;
 }
 
-void InstructionSet::ld16(u16 &SP) {
+template <typename Bus>
+void InstructionSet<Bus>::ld16(u16 &SP) {
     SP = get_n16();
 }
 
-void InstructionSet::ld_to_HL(u8 reg) {
+template <typename Bus>
+void InstructionSet<Bus>::ld_to_HL(u8 reg) {
     u16 addr = ((u16)regs.H << 8) | (u16)regs.L;
 
     bus.write(addr, reg);
     bus.emulate_cycles(1);
 }
 
-void InstructionSet::ld_to_HL() {
+template <typename Bus>
+void InstructionSet<Bus>::ld_to_HL() {
     u8 n8 = get_n8();
 
     u16 addr = ((u16)regs.H << 8) | (u16)regs.L;
@@ -90,7 +104,8 @@ void InstructionSet::ld_to_HL() {
     bus.emulate_cycles(1);
 }
 
-void InstructionSet::ld_to_A(u8 hi_reg, u8 lo_reg, addr_mode mode) {
+template <typename Bus>
+void InstructionSet<Bus>::ld_to_A(u8 hi_reg, u8 lo_reg, addr_mode mode) {
     u16 addr = ((u16)hi_reg << 8) | (u16)lo_reg;
 
     regs.A = bus.read(addr);
@@ -110,21 +125,24 @@ void InstructionSet::ld_to_A(u8 hi_reg, u8 lo_reg, addr_mode mode) {
     }
 }
 
-void InstructionSet::ld_to_A() {
+template <typename Bus>
+void InstructionSet<Bus>::ld_to_A() {
     u16 n16 = get_n16();
 
     regs.A = bus.read(n16);
     bus.emulate_cycles(1);
 }
 
-void InstructionSet::ld_from_HL(u8 &reg) {
+template <typename Bus>
+void InstructionSet<Bus>::ld_from_HL(u8 &reg) {
     u16 addr = ((u16)regs.H << 8) | (u16)regs.L;
 
     reg = bus.read(addr);
     bus.emulate_cycles(1);
 }
 
-void InstructionSet::ld_from_A(u8 hi_reg, u8 lo_reg, addr_mode mode) {
+template <typename Bus>
+void InstructionSet<Bus>::ld_from_A(u8 hi_reg, u8 lo_reg, addr_mode mode) {
     u16 addr = ((u16)hi_reg << 8) | (u16)lo_reg;
 
     bus.write(addr, regs.A);
@@ -144,14 +162,16 @@ void InstructionSet::ld_from_A(u8 hi_reg, u8 lo_reg, addr_mode mode) {
     }
 }
 
-void InstructionSet::ld_from_A() {
+template <typename Bus>
+void InstructionSet<Bus>::ld_from_A() {
     u16 n16 = get_n16();
 
     bus.write(n16, regs.A);
     bus.emulate_cycles(1);
 }
 
-void InstructionSet::ld_from_SP() {
+template <typename Bus>
+void InstructionSet<Bus>::ld_from_SP() {
     u16 n16 = get_n16();
 
     bus.write(n16, regs.SP & 0xFF);
@@ -160,7 +180,8 @@ void InstructionSet::ld_from_SP() {
     bus.emulate_cycles(1);
 }
 
-void InstructionSet::ldh_to_A(addr_mode mode) {
+template <typename Bus>
+void InstructionSet<Bus>::ldh_to_A(addr_mode mode) {
     if (mode == LDH_A8) {
         regs.A = bus.read(0xFF00 + (u16)get_n8());
     } else if (mode == LDH_C) {
@@ -169,7 +190,8 @@ void InstructionSet::ldh_to_A(addr_mode mode) {
     bus.emulate_cycles(1);
 }
 
-void InstructionSet::ldh_from_A(addr_mode mode) {
+template <typename Bus>
+void InstructionSet<Bus>::ldh_from_A(addr_mode mode) {
     if (mode == LDH_A8) {
         bus.write(0xFF00 + (u16)get_n8(), regs.A);
     } else if (mode == LDH_C) {
@@ -178,7 +200,8 @@ void InstructionSet::ldh_from_A(addr_mode mode) {
     bus.emulate_cycles(1);
 }
 
-void InstructionSet::ld_SP_signed() {
+template <typename Bus>
+void InstructionSet<Bus>::ld_SP_signed() {
     bus.emulate_cycles(1);
 
     char e8 = (char)get_n8();
@@ -194,7 +217,8 @@ void InstructionSet::ld_SP_signed() {
     regs.L = (regs.SP + e8) & 0xFF;
 }
 
-void InstructionSet::ld_SP_HL() {
+template <typename Bus>
+void InstructionSet<Bus>::ld_SP_HL() {
     bus.emulate_cycles(1);
     regs.SP = ((u16)regs.H << 8) | (u16)regs.L;
 }
@@ -202,7 +226,8 @@ void InstructionSet::ld_SP_HL() {
 // note: Stack grows "upside down" memory, and Game Boy memory stores
 // lowest byte first (little endian)
 
-void InstructionSet::push(u8 hi_reg, u8 lo_reg) {
+template <typename Bus>
+void InstructionSet<Bus>::push(u8 hi_reg, u8 lo_reg) {
 
     // Higher byte pushed first
     bus.write(--regs.SP, hi_reg);
@@ -213,7 +238,8 @@ void InstructionSet::push(u8 hi_reg, u8 lo_reg) {
     bus.emulate_cycles(1);
 }
 
-void InstructionSet::pop(u8 &hi_reg, u8 &lo_reg, addr_mode mode) {
+template <typename Bus>
+void InstructionSet<Bus>::pop(u8 &hi_reg, u8 &lo_reg, addr_mode mode) {
 
     // Lower byte popped first
     if (mode == DEFAULT) {
@@ -227,7 +253,8 @@ void InstructionSet::pop(u8 &hi_reg, u8 &lo_reg, addr_mode mode) {
     bus.emulate_cycles(1);
 }
 
-void InstructionSet::jp(bool cond_code) {
+template <typename Bus>
+void InstructionSet<Bus>::jp(bool cond_code) {
     u16 n16 = get_n16();
     if (cond_code) {
         regs.PC = n16;
@@ -235,11 +262,13 @@ void InstructionSet::jp(bool cond_code) {
     }
 }
 
-void InstructionSet::jp_HL() {
+template <typename Bus>
+void InstructionSet<Bus>::jp_HL() {
     regs.PC = ((u16)regs.H << 8) | (u16)regs.L;
 }
 
-void InstructionSet::jr(bool cond_code) {
+template <typename Bus>
+void InstructionSet<Bus>::jr(bool cond_code) {
     char e8 = (char)get_n8();
     u16 addr = regs.PC + e8;
     if (cond_code) {
@@ -251,7 +280,8 @@ void InstructionSet::jr(bool cond_code) {
 // note: Before calling a subroutine, you have to store the
 // current address onto stack to come back to where you left off
 
-void InstructionSet::call(bool cond_code) {
+template <typename Bus>
+void InstructionSet<Bus>::call(bool cond_code) {
     u16 n16 = get_n16();
 
     if (cond_code) {
@@ -266,7 +296,8 @@ void InstructionSet::call(bool cond_code) {
     }
 }
 
-void InstructionSet::ret(bool cond_code, addr_mode mode) {
+template <typename Bus>
+void InstructionSet<Bus>::ret(bool cond_code, addr_mode mode) {
     if (mode == RET_CC) {
         bus.emulate_cycles(1);
     }
@@ -283,12 +314,14 @@ void InstructionSet::ret(bool cond_code, addr_mode mode) {
     }
 }
 
-void InstructionSet::reti() {
+template <typename Bus>
+void InstructionSet<Bus>::reti() {
     ctx.IME = true;
     ret();
 }
 
-void InstructionSet::rst(u16 addr) {
+template <typename Bus>
+void InstructionSet<Bus>::rst(u16 addr) {
     bus.write(--regs.SP, (regs.PC >> 8) & 0xFF);
     bus.emulate_cycles(1);
     bus.write(--regs.SP, regs.PC & 0xFF);
@@ -298,7 +331,8 @@ void InstructionSet::rst(u16 addr) {
     bus.emulate_cycles(1);
 }
 
-void InstructionSet::inc(u8 &reg) {
+template <typename Bus>
+void InstructionSet<Bus>::inc(u8 &reg) {
     reg += 1;
     u8 val = reg;
 
@@ -310,7 +344,8 @@ void InstructionSet::inc(u8 &reg) {
     else { BIT_RESET(regs.F, 5); }
 }
 
-void InstructionSet::inc(u8 &hi_reg, u8 &lo_reg) {
+template <typename Bus>
+void InstructionSet<Bus>::inc(u8 &hi_reg, u8 &lo_reg) {
     bus.emulate_cycles(1);
 
     if (lo_reg == 0xFF) {
@@ -319,12 +354,14 @@ void InstructionSet::inc(u8 &hi_reg, u8 &lo_reg) {
     lo_reg++;
 }
 
-void InstructionSet::inc_SP() {
+template <typename Bus>
+void InstructionSet<Bus>::inc_SP() {
     bus.emulate_cycles(1);
     regs.SP++;
 }
 
-void InstructionSet::inc_HL() {
+template <typename Bus>
+void InstructionSet<Bus>::inc_HL() {
     u16 addr = ((u16)regs.H << 8) | (u16)regs.L;
 
     u8 val = bus.read(addr) + 1;
@@ -341,7 +378,8 @@ void InstructionSet::inc_HL() {
     else { BIT_RESET(regs.F, 5); }  
 }
 
-void InstructionSet::dec(u8 &reg) {
+template <typename Bus>
+void InstructionSet<Bus>::dec(u8 &reg) {
     reg -= 1;
     u8 val = reg;
 
@@ -353,7 +391,8 @@ void InstructionSet::dec(u8 &reg) {
     else { BIT_RESET(regs.F, 5); } 
 }
 
-void InstructionSet::dec(u8 &hi_reg, u8 &lo_reg) {
+template <typename Bus>
+void InstructionSet<Bus>::dec(u8 &hi_reg, u8 &lo_reg) {
     bus.emulate_cycles(1);
 
     if (lo_reg == 0x00) {
@@ -362,12 +401,14 @@ void InstructionSet::dec(u8 &hi_reg, u8 &lo_reg) {
     lo_reg--;
 }
 
-void InstructionSet::dec_SP() {
+template <typename Bus>
+void InstructionSet<Bus>::dec_SP() {
     bus.emulate_cycles(1);
     regs.SP--;
 }
 
-void InstructionSet::dec_HL() {
+template <typename Bus>
+void InstructionSet<Bus>::dec_HL() {
     u16 addr = ((u16)regs.H << 8) | (u16)regs.L;
 
     u8 val = bus.read(addr) - 1;
@@ -384,7 +425,8 @@ void InstructionSet::dec_HL() {
     else { BIT_RESET(regs.F, 5); } 
 }
 
-void InstructionSet::add(u8 reg) {
+template <typename Bus>
+void InstructionSet<Bus>::add(u8 reg) {
     u16 val = (u16)regs.A + (u16)reg;
     
     // flag calculations
@@ -399,17 +441,20 @@ void InstructionSet::add(u8 reg) {
     regs.A += reg;
 } 
 
-void InstructionSet::add() {
+template <typename Bus>
+void InstructionSet<Bus>::add() {
     add(get_n8());
 }    
 
-void InstructionSet::add_HL() {
+template <typename Bus>
+void InstructionSet<Bus>::add_HL() {
     u8 byte = bus.read(((u16)regs.H << 8) | (u16)regs.L);
     bus.emulate_cycles(1);
     add(byte);
 }
 
-void InstructionSet::add16(u8 hi_reg, u8 lo_reg) {
+template <typename Bus>
+void InstructionSet<Bus>::add16(u8 hi_reg, u8 lo_reg) {
     bus.emulate_cycles(1);
 
     // Let the compiler do the carrying
@@ -428,7 +473,8 @@ void InstructionSet::add16(u8 hi_reg, u8 lo_reg) {
     regs.L = (u8)(val & 0xFF);
 }      
 
-void InstructionSet::add16() {
+template <typename Bus>
+void InstructionSet<Bus>::add16() {
     bus.emulate_cycles(1);
 
     // Let the compiler do the carrying
@@ -445,7 +491,8 @@ void InstructionSet::add16() {
     regs.L = (u8)(val & 0xFF);
 }                         
 
-void InstructionSet::add_to_SP() {
+template <typename Bus>
+void InstructionSet<Bus>::add_to_SP() {
     bus.emulate_cycles(1);
 
     char e8 = (char)get_n8();
@@ -461,7 +508,8 @@ void InstructionSet::add_to_SP() {
     bus.emulate_cycles(1);
 }                     
 
-void InstructionSet::sub(u8 reg) {
+template <typename Bus>
+void InstructionSet<Bus>::sub(u8 reg) {
     
     // flag calculations
     if (regs.A - reg == 0) { BIT_SET(regs.F, 7); }
@@ -475,17 +523,20 @@ void InstructionSet::sub(u8 reg) {
     regs.A -= reg;
 }    
 
-void InstructionSet::sub() {
+template <typename Bus>
+void InstructionSet<Bus>::sub() {
     sub(get_n8());
 }         
 
-void InstructionSet::sub_HL() {
+template <typename Bus>
+void InstructionSet<Bus>::sub_HL() {
     u8 byte = bus.read(((u16)regs.H << 8) | (u16)regs.L);
     bus.emulate_cycles(1);
     sub(byte);
 } 
 
-void InstructionSet::adc(u8 reg) {
+template <typename Bus>
+void InstructionSet<Bus>::adc(u8 reg) {
     u16 c = BIT(regs.F, 4);
     u16 val = (u16)regs.A + (u16)reg + c;
     
@@ -502,17 +553,20 @@ void InstructionSet::adc(u8 reg) {
     
 }
 
-void InstructionSet::adc() {
+template <typename Bus>
+void InstructionSet<Bus>::adc() {
     adc(get_n8());
 }
 
-void InstructionSet::adc_HL() {
+template <typename Bus>
+void InstructionSet<Bus>::adc_HL() {
     u8 byte = bus.read(((u16)regs.H << 8) | (u16)regs.L);
     bus.emulate_cycles(1);
     adc(byte);
 }
 
-void InstructionSet::sbc(u8 reg) {
+template <typename Bus>
+void InstructionSet<Bus>::sbc(u8 reg) {
     u8 c = BIT(regs.F, 4);
     u8 val = reg + c;
 
@@ -527,17 +581,20 @@ void InstructionSet::sbc(u8 reg) {
     regs.A -= val;
 }
 
-void InstructionSet::sbc() {
+template <typename Bus>
+void InstructionSet<Bus>::sbc() {
     sbc(get_n8());
 }
 
-void InstructionSet::sbc_HL() {
+template <typename Bus>
+void InstructionSet<Bus>::sbc_HL() {
     u8 byte = bus.read(((u16)regs.H << 8) | (u16)regs.L);
     bus.emulate_cycles(1);
     sbc(byte);
 }
 
-void InstructionSet::and_A(u8 reg) {
+template <typename Bus>
+void InstructionSet<Bus>::and_A(u8 reg) {
     regs.A &= reg;
 
     if (regs.A == 0) { BIT_SET(regs.F,7); }
@@ -547,16 +604,19 @@ void InstructionSet::and_A(u8 reg) {
     BIT_RESET(regs.F, 4);
 }
 
-void InstructionSet::and_A() {
+template <typename Bus>
+void InstructionSet<Bus>::and_A() {
     and_A(get_n8());
 }
 
-void InstructionSet::and_A_HL() {
+template <typename Bus>
+void InstructionSet<Bus>::and_A_HL() {
     bus.emulate_cycles(1);
     and_A(bus.read(((u16)regs.H << 8) | (u16)regs.L));
 }
 
-void InstructionSet::or_A(u8 reg) {
+template <typename Bus>
+void InstructionSet<Bus>::or_A(u8 reg) {
     regs.A |= reg;
 
     if (regs.A == 0) { BIT_SET(regs.F,7); }
@@ -566,16 +626,19 @@ void InstructionSet::or_A(u8 reg) {
     BIT_RESET(regs.F, 4);
 }
 
-void InstructionSet::or_A() {
+template <typename Bus>
+void InstructionSet<Bus>::or_A() {
     or_A(get_n8());
 }
 
-void InstructionSet::or_A_HL() {
+template <typename Bus>
+void InstructionSet<Bus>::or_A_HL() {
     bus.emulate_cycles(1);
     or_A(bus.read(((u16)regs.H << 8) | (u16)regs.L));
 }
 
-void InstructionSet::xor_A(u8 reg) {
+template <typename Bus>
+void InstructionSet<Bus>::xor_A(u8 reg) {
     regs.A ^= reg;
 
     if (regs.A == 0) { BIT_SET(regs.F,7); }
@@ -585,16 +648,19 @@ void InstructionSet::xor_A(u8 reg) {
     BIT_RESET(regs.F, 4);
 }
 
-void InstructionSet::xor_A() {
+template <typename Bus>
+void InstructionSet<Bus>::xor_A() {
     xor_A(get_n8());
 }
 
-void InstructionSet::xor_A_HL() {
+template <typename Bus>
+void InstructionSet<Bus>::xor_A_HL() {
     bus.emulate_cycles(1);
     xor_A(bus.read(((u16)regs.H << 8) | (u16)regs.L));
 }
 
-void InstructionSet::cp(u8 reg) {
+template <typename Bus>
+void InstructionSet<Bus>::cp(u8 reg) {
     if ((regs.A - reg) == 0) { BIT_SET(regs.F, 7); }
     else { BIT_RESET(regs.F, 7); }    
     BIT_SET(regs.F, 6);
@@ -604,67 +670,80 @@ void InstructionSet::cp(u8 reg) {
     else { BIT_RESET(regs.F, 4); } 
 }
 
-void InstructionSet::cp() {
+template <typename Bus>
+void InstructionSet<Bus>::cp() {
     cp(get_n8());
 }
 
-void InstructionSet::cp_HL() {
+template <typename Bus>
+void InstructionSet<Bus>::cp_HL() {
     bus.emulate_cycles(1);
     cp(bus.read(((u16)regs.H << 8) | (u16)regs.L));
 } 
 
-void InstructionSet::cpl() {
+template <typename Bus>
+void InstructionSet<Bus>::cpl() {
     regs.A = ~regs.A;
     BIT_SET(regs.F, 6);
     BIT_SET(regs.F, 5);
 }
 
-void InstructionSet::ccf() {
+template <typename Bus>
+void InstructionSet<Bus>::ccf() {
     BIT_RESET(regs.F, 6);
     BIT_RESET(regs.F, 5);
     if (BIT(regs.F, 4)) { BIT_RESET(regs.F, 4); }
     else { BIT_SET(regs.F, 4); }
 }
 
-void InstructionSet::scf() {
+template <typename Bus>
+void InstructionSet<Bus>::scf() {
     BIT_RESET(regs.F, 6);
     BIT_RESET(regs.F, 5);
     BIT_SET(regs.F, 4);
 }
 
-void InstructionSet::rlca() {
+template <typename Bus>
+void InstructionSet<Bus>::rlca() {
     shift(RLC, regs.A);
     BIT_RESET(regs.F, 7);
 }
 
-void InstructionSet::rrca() {
+template <typename Bus>
+void InstructionSet<Bus>::rrca() {
     shift(RRC, regs.A);
     BIT_RESET(regs.F, 7);
 }
 
-void InstructionSet::rla() {
+template <typename Bus>
+void InstructionSet<Bus>::rla() {
     shift(RL, regs.A);
     BIT_RESET(regs.F, 7);
 }
 
-void InstructionSet::rra() {
+template <typename Bus>
+void InstructionSet<Bus>::rra() {
     shift(RR, regs.A);
     BIT_RESET(regs.F, 7);
 }
 
-void InstructionSet::di() {
+template <typename Bus>
+void InstructionSet<Bus>::di() {
     ctx.IME = false;
 }
 
-void InstructionSet::ei() {
+template <typename Bus>
+void InstructionSet<Bus>::ei() {
     ctx.IME_next = true;
 }
 
-void InstructionSet::halt() {
+template <typename Bus>
+void InstructionSet<Bus>::halt() {
     ctx.halted = true;
 }
 
-void InstructionSet::shift(addr_mode mode, u8 &reg) {
+template <typename Bus>
+void InstructionSet<Bus>::shift(addr_mode mode, u8 &reg) {
     u8 bit7 = (reg >> 7) & 0x1;
     u8 bit0 = reg & 0x1;
     u8 c = BIT(regs.F, 4);
@@ -718,7 +797,8 @@ void InstructionSet::shift(addr_mode mode, u8 &reg) {
     BIT_RESET(regs.F, 5);
 }
 
-void InstructionSet::shift_HL(addr_mode mode) {
+template <typename Bus>
+void InstructionSet<Bus>::shift_HL(addr_mode mode) {
     u16 addr = ((u16)regs.H << 8) | (u16)regs.L;
     u8 byte = bus.read(addr);
     bus.emulate_cycles(1);
@@ -800,7 +880,8 @@ void InstructionSet::shift_HL(addr_mode mode) {
     BIT_RESET(regs.F, 5);
 }
 
-void InstructionSet::bit_flag(addr_mode mode, u8 bit, u8 &reg) {
+template <typename Bus>
+void InstructionSet<Bus>::bit_flag(addr_mode mode, u8 bit, u8 &reg) {
     switch (mode) {
         case BIT:
             if (!BIT(reg, bit)) { BIT_SET(regs.F, 7); }
@@ -818,7 +899,8 @@ void InstructionSet::bit_flag(addr_mode mode, u8 bit, u8 &reg) {
     }
 }
 
-void InstructionSet::bit_flag_HL(addr_mode mode, u8 bit) {
+template <typename Bus>
+void InstructionSet<Bus>::bit_flag_HL(addr_mode mode, u8 bit) {
     u16 addr = ((u16)regs.H << 8) | (u16)regs.L;
     u8 byte = bus.read(addr);
     bus.emulate_cycles(1);
@@ -842,4 +924,8 @@ void InstructionSet::bit_flag_HL(addr_mode mode, u8 bit) {
             break;
         default: break;
     }
-}
\ No newline at end of file
+}
+
+// The emulator runs on the real memory map, gb-sm83 on a flat one
+template class InstructionSet<MemoryBus>;
+template class InstructionSet<FlatBus>;
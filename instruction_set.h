@@ -28,17 +28,19 @@ typedef enum {
     SET
 } addr_mode;
 
+// Bus is MemoryBus, or FlatBus for the single-step tests
+template <typename Bus>
 class InstructionSet {
     private:
         Registers &regs;
         CpuContext &ctx;
-        MemoryBus &bus;
+        Bus &bus;
 
         // Helper functions for getting bytes in opcodes
         u8 get_n8();
         u16 get_n16();
     public:
-        InstructionSet(Registers &regs_, CpuContext &ctx_, MemoryBus &bus_);
+        InstructionSet(Registers &regs_, CpuContext &ctx_, Bus &bus_);
         ~InstructionSet();
 
         /** 
@@ -1,11 +1,16 @@
 #include "interrupt_handler.h"
+#include "flat_bus.h"
 
-InterruptHandler::InterruptHandler(
-    Registers &regs_, CpuContext &ctx_, MemoryBus &bus_
-) : regs(regs_), ctx(ctx_), bus(bus_) {}
-InterruptHandler::~InterruptHandler() {}
+template <typename Bus>
+InterruptHandler<Bus>::InterruptHandler(
+    MachineState &state_, Bus &bus_
+) : state(state_), regs(state_.regs), ctx(state_.ctx), bus(bus_) {}
+template <typename Bus>
+InterruptHandler<Bus>::~InterruptHandler() {}
 
-void InterruptHandler::service_interrupt(interrupt_type type) {
+template <typename Bus>
+void InterruptHandler<Bus>::service_interrupt(interrupt_type type) {
+    GB_COUNT(interrupts[type]);
     bus.emulate_cycles(2);
 
     // Choose the right interrupt
@@ -19,7 +24,7 @@ void InterruptHandler::service_interrupt(interrupt_type type) {
         case (Int_VBlank):   int_handler_addr = 0x40; disable = ~0x01; break;
     }
 
-    bus.set_IF(bus.get_IF() & disable);  // Acknowledge interrupt
+    state.IF &= disable;                 // Acknowledge interrupt
     ctx.IME = 0;                         // Prevent any further interrupts
     ctx.halted = false;                  // CPU resumes after interrupt handling
 
@@ -33,9 +38,10 @@ void InterruptHandler::service_interrupt(interrupt_type type) {
     bus.emulate_cycles(1);
 } 
 
-void InterruptHandler::handle_interrupts() {
-    u8 IF = bus.get_IF();
-    u8 IE = bus.get_IE();
+template <typename Bus>
+void InterruptHandler<Bus>::handle_interrupts() {
+    u8 IF = state.IF;
+    u8 IE = state.IE;
 
     bool joypad_requested = IF & 0x10;
     bool serial_requested = IF & 0x08;
@@ -69,4 +75,7 @@ void InterruptHandler::handle_interrupts() {
         // std::cout << "Servicing Joypad interrupt\n";
         service_interrupt(Int_Joypad);
     }
-}
\ No newline at end of file
+}
+
+template class InterruptHandler<MemoryBus>;
+template class InterruptHandler<FlatBus>;
@@ -4,6 +4,7 @@
 #include "common.h"
 #include "memory.h"
 #include "cpu_util.h"
+#include "machine_state.h"
 
 typedef enum {
     Int_VBlank,
@@ -13,13 +14,15 @@ typedef enum {
     Int_Joypad
 } interrupt_type;
 
+template <typename Bus>
 class InterruptHandler {
     private:
+        MachineState &state;
         Registers &regs;    
         CpuContext &ctx;
-        MemoryBus &bus;
+        Bus &bus;
     public:
-        InterruptHandler(Registers &regs_, CpuContext &ctx, MemoryBus &bus_);
+        InterruptHandler(MachineState &state_, Bus &bus_);
         ~InterruptHandler();
         void handle_interrupts();
         void service_interrupt(interrupt_type type);
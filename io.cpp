@@ -1,19 +1,33 @@
 #include "io.h"
 
-IO::IO(Joypad &joypad_) : joypad(joypad_) {}
+IO::IO(MachineState &state_, Joypad &joypad_, Timer &timer_, APU &apu_) 
+    : state(state_), joypad(joypad_), timer(timer_), apu(apu_) {}
 IO::~IO() {}
 
+void IO::reset() {
+    serial_out.clear();
+}
+
 u8 IO::read(u16 addr) {
+    GB_COUNT(io_reads[addr & 0x7F]);
+    return read_reg(addr, false);
+}
+
+u8 IO::peek(u16 addr) {
+    return read_reg(addr, true);
+}
+
+u8 IO::read_reg(u16 addr, bool quiet) {
     if (addr == 0xFF00) {
         return joypad.read();
 
     } else if (addr == 0xFF01) {
         // std::cout << "Reading from SB!" << std::endl;
-        return serial_data[0];
+        return state.SB;
 
     } else if (addr == 0xFF02) {
         // std::cout << "Reading from SC!" << std::endl;
-        return serial_data[1];
+        return state.SC;
 
     } else if (0xFF04 <= addr && addr <= 0xFF07) {
         // Reading timers
@@ -21,66 +35,63 @@ u8 IO::read(u16 addr) {
 
     } else if (addr == 0xFF0F) {
         // Reading Interrupt flags (IF)
-        return IF;
+        return state.IF;
 
     } 
 
     // LCD-related registers
     else if (addr == 0xFF40) {
         // Reading LCD control
-        return LCDC;
+        return state.LCDC;
 
     } else if (addr == 0xFF41) {
         // Reading LCD status
-        return STAT;
+        return state.STAT;
 
     } else if (addr == 0xFF42) {
         // Reading Background viewport Y
-        return SCY;
+        return state.SCY;
 
     } else if (addr == 0xFF43) {
         // Reading Background viewport X
-        return SCX;
+        return state.SCX;
 
     } else if (addr == 0xFF44) {
         // Reading LCD Y coordinate
-        return LY;
+        return state.LY;
 
     } else if (addr == 0xFF45) {
         // Reading LY compare
-        return LYC;
+        return state.LYC;
 
     } else if (addr == 0xFF47) {
         // Reading Background palette
-        return BGP;
+        return state.BGP;
     
     } else if (addr == 0xFF48) {
         // Reading Sprite palette 0
-        return OBP0;
+        return state.OBP0;
     
     } else if (addr == 0xFF49) {
         // Reading Sprite palette 1
-        return OBP1;
+        return state.OBP1;
 
     } else if (addr == 0xFF4A) {
         // Reading Window pos Y
-        return WY;
+        return state.WY;
 
     } else if (addr == 0xFF4B) {
         // Reading Window pos X plus 7
-        return WX;
-
-    }
+        return state.WX;
 
-    else if (addr >= 0xFF10 && addr <= 0xFF26) {
-        // Haven't support audio
     }
 
-    else if (addr >= 0xFF30 && addr <= 0xFF3F) {
-        // Haven't support audio
+    else if (addr >= 0xFF10 && addr <= 0xFF3F) {
+        // Reading sound registers and wave RAM
+        return quiet ? apu.peek(addr) : apu.read(addr);
     }
     
-    else {
+    else if (!quiet) {
         std::cout << "Unsupported bus read at: 0x" << std::hex << addr << std::endl;
 
     }
@@ -89,16 +100,28 @@ u8 IO::read(u16 addr) {
 }
 
 void IO::write(u16 addr, u8 val) {
+    GB_COUNT(io_writes[addr & 0x7F]);
     if (addr == 0xFF00) {
         joypad.write(val);
 
     } else if (addr == 0xFF01) {
         // std::cout << "Writing to SB!" << std::endl;
-        serial_data[0] = val;
+        state.SB = val;
 
     } else if (addr == 0xFF02) {
         // std::cout << "Writing to SC!" << std::endl;
-        serial_data[1] = val;
+        state.SC = val;
+
+        // Nothing is ever plugged in, so a transfer on the internal clock
+        // finishes at once. Test ROMs print their results this way. With
+        // no partner, 1s are shifted in, and the serial interrupt follows.
+        if ((val & 0x81) == 0x81) {
+            if (serial_out.size() >= 0x10000) serial_out.erase(0, 0x8000);
+            serial_out.push_back(state.SB);
+            state.SB = 0xFF;
+            state.SC &= 0x7F;
+            state.IF |= 0b1000;
+        }
 
     } else if (0xFF04 <= addr && addr <= 0xFF07) {
         // Writing to timers
@@ -106,61 +129,56 @@ void IO::write(u16 addr, u8 val) {
 
     } else if (addr == 0xFF0F) {
         // Writing to Interrupt flags (IF)
-        IF = val;
+        state.IF = val;
         
     } 
     
     // LCD-related registers
     else if (addr == 0xFF40) {
         // Writing to LCD control
-        LCDC = val;
+        state.LCDC = val;
 
     } else if (addr == 0xFF41) {
         // Writing to LCD status
-        STAT = val;
+        state.STAT = val;
         
     } else if (addr == 0xFF42) {
         // Writing to Background viewport Y
-        SCY = val;
+        state.SCY = val;
         
     } else if (addr == 0xFF43) {
         // Writing to Background viewport X
-        SCX = val;
+        state.SCX = val;
         
     } else if (addr == 0xFF45) {
         // Writing to LY compare
-        LYC = val;
+        state.LYC = val;
 
     } else if (addr == 0xFF47) {
         // Writing to Background palette
-        BGP = val;
+        state.BGP = val;
 
     } else if (addr == 0xFF48) {
         // Writing to Sprite palette 0
-        OBP0 = val;
+        state.OBP0 = val;
 
     } else if (addr == 0xFF49) {
         // Writing to Sprite palette 1
-        OBP1 = val;
+        state.OBP1 = val;
 
     } else if (addr == 0xFF4A) {
         // Writing to Window pos Y
-        WY = val;
+        state.WY = val;
 
     } else if (addr == 0xFF4B) {
         // Writing to Window pos X plus 7
-        WX = val;
-
-    }
+        state.WX = val;
 
-    else if (addr >= 0xFF10 && addr <= 0xFF26) {
-        // Haven't support audio
-        
     }
 
-    else if (addr >= 0xFF30 && addr <= 0xFF3F) {
-        // Haven't support audio
-        
+    else if (addr >= 0xFF10 && addr <= 0xFF3F) {
+        // Writing to sound registers and wave RAM
+        apu.write(addr, val);
     }
     
     else {
@@ -168,111 +186,16 @@ void IO::write(u16 addr, u8 val) {
     }
 }
 
-u8 IO::get_IF() {
-    return IF;
-}
-
-void IO::set_IF(u8 val) {
-    IF = val;
-}
-
-u8 IO::get_IE() {
-    return IE;
-}
-
-void IO::set_IE(u8 val) {
-    IE = val;
-}
-
-u8 IO::get_LCDC() {
-    return LCDC;
-}
-
-void IO::set_LCDC(u8 val) {
-    LCDC = val;
-}
-
-u8 IO::get_STAT() {
-    return STAT;
-}
-
-void IO::set_STAT(u8 val) {
-    STAT = val;
-}
-
-u8 IO::get_SCY() {
-    return SCY;
-}
-
-void IO::set_SCY(u8 val) {
-    SCY = val;
-}
-
-u8 IO::get_SCX() {
-    return SCX;
-}
-
-void IO::set_SCX(u8 val) {
-    SCX = val;
-}
-
-
-u8 IO::get_LY() {
-    return LY;
-}
-
-void IO::set_LY(u8 val) {
-    LY = val;
-}
-
-u8 IO::get_LYC() {
-    return LYC;
-}
-
-void IO::set_LYC(u8 val) {
-    LYC = val;
-}
-
-u8 IO::get_BGP() {
-    return BGP;
-}
-
-void IO::set_BGP(u8 val) {
-    BGP = val;
-}
-
-u8 IO::get_OBP0() {
-    return OBP0;
-}
-
-void IO::set_OBP0(u8 val) {
-    OBP0 = val;
-}
-
-u8 IO::get_OBP1() {
-    return OBP1;
-}
-
-void IO::set_OBP1(u8 val) {
-    OBP1 = val;
-}
-
-u8 IO::get_WY() {
-    return WY;
-}
-
-void IO::set_WY(u8 val) {
-    WY = val;
-}
-
-u8 IO::get_WX() {
-    return WX;
+const std::string &IO::get_serial() {
+    return serial_out;
 }
 
-void IO::set_WX(u8 val) {
-    WX = val;
+void IO::serialize(SaveState &save) {
+    joypad.serialize(save);
+    apu.serialize(save);
 }
 
-bool IO::timer_tick() {
-    return timer.tick();
+void IO::deserialize(const SaveState &save) {
+    joypad.deserialize(save);
+    apu.deserialize(save);
 }
\ No newline at end of file
@@ -3,6 +3,12 @@
 Joypad::Joypad() {}
 Joypad::~Joypad() {}
 
+void Joypad::reset() {
+    // Buttons are physical, so only the select lines go back
+    buttons_select = 0;
+    dpad_select = 0;
+}
+
 u8 Joypad::read() {
     u8 output;
     if (!dpad_select) {
@@ -34,4 +40,20 @@ void Joypad::update(joypad_button button, bool pressed) {
         case Button_Start: start = !pressed; break;
         case Button_Select: select = !pressed; break;
     }
+}
+
+u8 Joypad::get_pressed() {
+    return (!up << Dpad_Up) | (!down << Dpad_Down) | (!left << Dpad_Left) | (!right << Dpad_Right)
+        | (!a << Button_A) | (!b << Button_B) | (!start << Button_Start) | (!select << Button_Select);
+}
+
+void Joypad::serialize(SaveState &save) {
+    save.joypad.buttons_select = buttons_select;
+    save.joypad.dpad_select = dpad_select;
+}
+
+void Joypad::deserialize(const SaveState &save) {
+    // Button levels are left alone: they mirror what the host is holding
+    buttons_select = save.joypad.buttons_select;
+    dpad_select = save.joypad.dpad_select;
 }
\ No newline at end of file
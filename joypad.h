@@ -2,6 +2,7 @@
 #define JOYPAD_H
 
 #include "common.h"
+#include "save_state.h"
 
 typedef enum {
     Dpad_Up,
@@ -29,9 +30,13 @@ class Joypad {
     public:
         Joypad();
         ~Joypad();
+        void reset();
         u8 read();
         void write(u8 val);
         void update(joypad_button button, bool pressed);
+        u8 get_pressed(); // Bit n set while joypad_button n is held
+        void serialize(SaveState &save);
+        void deserialize(const SaveState &save);
         
 };
 
@@ -0,0 +1,61 @@
+#ifndef MACHINE_STATE_H
+#define MACHINE_STATE_H
+
+#include "common.h"
+#include "cpu_util.h"
+#include <type_traits>
+
+// Hot state touched on (nearly) every step, gathered in one cache-line
+// aligned block. Components hold a reference to it and use the fields
+// directly instead of going through each other's getters, and the whole
+// thing is copied as one unit for snapshots. Fields are ordered so the
+// block has no implicit padding, which keeps snapshots byte-for-byte
+// deterministic.
+// https://gbdev.io/pandocs/Power_Up_Sequence.html#hardware-registers
+struct alignas(64) MachineState {
+    // CPU
+    Registers regs;
+    CpuContext ctx;
+
+    // Interrupts
+    u8 IE = 0x00;   // 0xFFFF: Interrupt enable register
+    u8 IF = 0xE1;   // 0xFF0F: Interrupt flag register
+
+    // Timer
+    u8 TIMA = 0x00;   // 0xFF05: Timer counter
+    u16 DIV = 0xAB00; // 0xFF04: Divider (only the upper byte is visible)
+    u8 TMA = 0x00;    // 0xFF06: Timer modulo
+    u8 TAC = 0xF8;    // 0xFF07: Timer control
+
+    // LCD
+    u8 LCDC = 0x91; // 0xFF40: LCD control
+    u8 STAT = 0x85; // 0xFF41: LCD status
+    u8 SCY = 0x00;  // 0xFF42: Background viewport Y pos.
+    u8 SCX = 0x00;  // 0xFF43: Background viewport X pos.
+    u8 LY = 0x00;   // 0xFF44: LCD Y coordinate
+    u8 LYC = 0x00;  // 0xFF45: LY compare
+    u8 BGP = 0xFC;  // 0xFF47: Background and window palette
+    u8 OBP0 = 0x00; // 0xFF48: Sprite palette 0
+    u8 OBP1 = 0x00; // 0xFF49: Sprite palette 1
+    u8 WY = 0x00;   // 0xFF4A: Window Y position
+    u8 WX = 0x00;   // 0xFF4B: Window X position plus 7
+
+    // Serial
+    u8 SB = 0x00;   // 0xFF01: Serial transfer data
+    u8 SC = 0x00;   // 0xFF02: Serial transfer control
+
+    u8 pad = 0;
+    int32_t dots = 0; // PPU position within the current scanline
+
+    u64 cycles = 0;   // T-cycles since power on
+
+    u8 reserved[16] = {0}; // Fills the rest of the cache line
+};
+
+static_assert(std::is_trivially_copyable<MachineState>::value,
+    "MachineState is copied as a single block");
+static_assert(std::has_unique_object_representations<MachineState>::value,
+    "MachineState must not contain implicit padding");
+static_assert(sizeof(MachineState) == 64, "MachineState should fill one cache line");
+
+#endif
@@ -1,35 +1,252 @@
-#include "memory.h"
-#include "cpu.h"
+#include "emulator.h"
+#include "rewind.h"
+#include "audio.h"
+#include "av_dump.h"
+#include "movie.h"
+#include <chrono>
+#include <unordered_map>
+
+// Reports the profile whichever way main returns
+struct ProfileOutput {
+    Profiler profiler;
+    const char *path = nullptr;
+
+    ~ProfileOutput() {
+        if (!path) return;
+        profiler.print_report(std::cout);
+        if (profiler.write_folded(path)) std::cout << "Folded stacks written to " << path << std::endl;
+    }
+};
+
+// Writes the trace whichever way main returns
+struct TraceOutput {
+    const char *path = nullptr;
+
+    ~TraceOutput() {
+        if (!path) return;
+        trace_stop();
+        if (trace_write(path)) std::cout << "Trace written to " << path << std::endl;
+    }
+};
+
+// Hand the samples from the last frame to the audio device
+void output_audio(APU &apu, AudioOutput &audio) {
+    static int16_t samples[2 * 4096];
+    apu.end_frame();
+    u32 count = apu.read_samples(samples, 4096);
+    audio.push(samples, count);
+
+    // Steer the next frame's sample count by how full the device ring is
+    apu.set_sample_rate(audio.adjusted_rate());
+}
+
+// Record video and audio to files without a window or pacing
+int dump_av(Emulator &emu, const char *prefix, bool raw_rgb, u64 frames, Movie *movie) {
+    APU &apu = emu.get_apu();
+    const u32 sample_rate = 48000;
+    AVDump dump;
+    if (!dump.open(prefix, raw_rgb, sample_rate)) return -3;
+
+    apu.set_sample_rate(sample_rate);
+    apu.set_output_enabled(true);
+
+    static int16_t samples[2 * 4096];
+    if (movie) frames = movie->frames();
+    for (u64 i = 0; i < frames; i++) {
+        if (movie) emu.set_joypad(movie->input(i));
+        if (!emu.run_frame()) {
+            std::cout << "CPU could not step\n";
+            dump.close();
+            return -2;
+        }
+
+        dump.add_frame(emu.framebuffer());
+
+        apu.end_frame();
+        u32 count = apu.read_samples(samples, 4096);
+        dump.add_audio(samples, count);
+    }
+
+    if (!dump.close()) {
+        std::cout << "Dump files could not be written\n";
+        return -3;
+    }
+    std::cout << "Dumped " << frames << " frames to " << prefix << std::endl;
+    return 0;
+}
+
+// Hash lists have a "frame hash" line per frame, hash in hex, the same
+// as gb-replay writes
+bool load_hashes(const char *path, std::unordered_map<u64, u64> &hashes) {
+    std::ifstream ifs;
+    ifs.open(path);
+    if (ifs.fail()) {
+        std::cout << "Hash list failed to open\n";
+        return false;
+    }
+    u64 frame, hash;
+    while (ifs >> std::dec >> frame >> std::hex >> hash) hashes[frame] = hash;
+    return true;
+}
+
+// Run unthrottled without a window, then report where we ended up.
+// Frame hashes can be written out, checked against a golden list, or both.
+int run_headless(Emulator &emu, u64 frames, Movie *movie, const char *hash_path, const char *golden_path) {
+    if (movie) frames = movie->frames();
+
+    std::ofstream hash_out;
+    if (hash_path) {
+        hash_out.open(hash_path);
+        if (hash_out.fail()) {
+            std::cout << "Hash list failed to be created\n";
+            return -1;
+        }
+    }
+    std::unordered_map<u64, u64> golden;
+    if (golden_path && !load_hashes(golden_path, golden)) return -1;
+
+    auto start = std::chrono::steady_clock::now();
+    for (u64 i = 0; i < frames; i++) {
+        if (movie) emu.set_joypad(movie->input(i));
+        if (!emu.run_frame()) {
+            std::cout << "CPU could not step\n";
+            return -2;
+        }
+        if (!hash_path && !golden_path) continue;
+
+        u64 hash = emu.frame_hash();
+        if (hash_path) {
+            hash_out << std::dec << i << " " << std::hex << std::setw(16) << std::setfill('0') << hash << "\n";
+        }
+
+        // Stop at the first difference and keep a picture of it
+        auto expected = golden.find(i);
+        if (expected != golden.end() && expected->second != hash) {
+            std::string ppm = std::string(golden_path) + ".frame" + std::to_string(i) + ".ppm";
+            std::cout << "Frame " << std::dec << i << " differs from the golden list (expected "
+                << std::hex << std::setw(16) << std::setfill('0') << expected->second << ", got "
+                << std::setw(16) << hash << ")\n";
+            if (emu.save_screenshot(ppm.c_str())) std::cout << "Saved the frame to " << ppm << std::endl;
+            return -5;
+        }
+    }
+    std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+
+    std::cout << "Ran " << std::dec << frames << " frames in " << std::fixed << std::setprecision(3)
+        << elapsed.count() << " s (" << std::setprecision(1) << frames / elapsed.count()
+        << " frames/s), state CRC " << std::hex << std::setw(8) << std::setfill('0')
+        << state_crc(emu) << std::endl;
+
+    if (golden_path) std::cout << "All frames match the golden list\n";
+    if (movie && movie->has_end()) {
+        if (!movie->matches_end(emu)) {
+            std::cout << "Replay desynced from the recording\n";
+            return -4;
+        }
+        std::cout << "Replay matches the recording\n";
+    }
+    return 0;
+}
 
 int main(int argc, char** argv) {
     
     // std::freopen("log.txt","w",stdout);
 
+    // Grab options if supplied
+    char *ROM = argv[argc - 1];
+    char *SAV = nullptr;
+    std::string state_path = std::string(ROM) + ".state";
+    int rewind_interval = 2; // in frames, 0 turns rewinding off
+    int run_ahead = 0;       // in frames, 0 turns run-ahead off
+    char *dump_prefix = nullptr;
+    bool dump_rgb = false;
+    u64 dump_frames = 36000; // 10 minutes
+    char *record_path = nullptr;
+    char *play_path = nullptr;
+    bool headless = false;
+    char *hash_path = nullptr;
+    char *golden_path = nullptr;
+    char *sym_path = nullptr;
+    ProfileOutput profile; // Outlives emu, which points at it
+    TraceOutput trace;
+    ExecTrace exec_trace;  // Also outlives emu
+    char *exec_trace_path = nullptr;
+    const option long_options[] = {
+        {"dump-av", required_argument, nullptr, 'd'},
+        {"raw-rgb", no_argument, nullptr, 'g'},
+        {"frames", required_argument, nullptr, 'n'},
+        {"record", required_argument, nullptr, 'm'},
+        {"play", required_argument, nullptr, 'p'},
+        {"headless", no_argument, nullptr, 'h'},
+        {"hashes", required_argument, nullptr, 'x'},
+        {"golden", required_argument, nullptr, 'c'},
+        {"profile", required_argument, nullptr, 'f'},
+        {"sym", required_argument, nullptr, 'y'},
+        {"trace", required_argument, nullptr, 'e'},
+        {"exec-trace", required_argument, nullptr, 'i'},
+        {nullptr, 0, nullptr, 0}
+    };
+    int opt;
+    while ((opt = getopt_long(argc, argv, "s:t:r:a:", long_options, nullptr)) != -1) {
+        switch (opt) {
+            case 's': SAV = optarg; break;
+            case 't': state_path = optarg; break;
+            case 'r': rewind_interval = atoi(optarg); break;
+            case 'a': run_ahead = atoi(optarg); break;
+            case 'd': dump_prefix = optarg; break;
+            case 'g': dump_rgb = true; break;
+            case 'n': dump_frames = strtoull(optarg, nullptr, 10); break;
+            case 'm': record_path = optarg; break;
+            case 'p': play_path = optarg; break;
+            case 'h': headless = true; break;
+            case 'x': hash_path = optarg; headless = true; break;
+            case 'c': golden_path = optarg; headless = true; break;
+            case 'f': profile.path = optarg; break;
+            case 'y': sym_path = optarg; break;
+            case 'e': trace.path = optarg; break;
+            case 'i': exec_trace_path = optarg; break;
+        }
+    }
+
+    if (trace.path) trace_start();
+
+    // Builds with counters report them however the run ends
+    if (counters_enabled()) atexit([] { print_counters(std::cout, thread_counters()); });
+
     // Setup Game Boy components
-    Cartridge cart;
-    Joypad joypad;
-    IO io(joypad);
-    EventHandler event_handler(joypad, io);
-    PPU ppu(io, event_handler);
-    MemoryBus bus(cart, io, ppu);
-    CPU cpu(bus);
+    Emulator emu(dump_prefix != nullptr || headless);
+    Cartridge &cart = emu.get_cart();
+    APU &apu = emu.get_apu();
+    PPU &ppu = emu.get_ppu();
+    EventHandler &event_handler = emu.get_event_handler();
 
     // Load game ROM
-    char *ROM = argv[argc - 1];
-    if (!cart.load_rom(ROM)) {
+    if (!emu.load_rom(ROM)) {
         std::cout << "ROM could not be loaded\n";
         return -1;
     } 
 
-    // Grab SAV filename if supplied
-    char *SAV = nullptr;
-    int opt;
-    while ((opt = getopt(argc, argv, "s:")) != -1) {
-        switch (opt) {
-            case 's': SAV = optarg; break;
-        }
+    // Profile the guest, named from game.sym next to the ROM unless told
+    // otherwise. Run-ahead frames would be counted twice, so it's off.
+    if (profile.path) {
+        std::string rom_sym = std::string(ROM).substr(0, std::string(ROM).rfind('.')) + ".sym";
+        if (sym_path) profile.profiler.load_symbols(sym_path);
+        else if (std::ifstream(rom_sym).good()) profile.profiler.load_symbols(rom_sym.c_str());
+        emu.set_profiler(&profile.profiler);
+        run_ahead = 0;
     }
 
+    // The trace is what actually ran, so no speculative frames either
+    if (exec_trace_path) {
+        if (!exec_trace.open(exec_trace_path)) return -1;
+        emu.set_exec_trace(&exec_trace);
+        run_ahead = 0;
+    }
+
+    // Movies check the whole state, picture included, so the picture
+    // carried over from a speculative frame would never replay the same
+    if (record_path || play_path) run_ahead = 0;
+
     // Load game SAV file when supported
     switch (cart.get_type()) {
         case 0x03: // MBC1+RAM+BATTERY
@@ -38,17 +255,135 @@ int main(int argc, char** argv) {
                 std::cout << "SAV file could not be loaded\n";
     }
     
-    // Main emulation loop
+    // Movies start from the state the game is in now, SAV included
+    Movie movie;
+    Movie *playing = nullptr;
+    if (play_path) {
+        if (!movie.load_file(play_path) || !movie.rewind(emu)) {
+            std::cout << "Movie could not be played\n";
+            return -1;
+        }
+        playing = &movie;
+    } else if (record_path) {
+        movie.begin(emu);
+    }
+
+    // Dumping and headless runs go as fast as possible, then exit
+    if (dump_prefix) return dump_av(emu, dump_prefix, dump_rgb, dump_frames, playing);
+    if (headless) return run_headless(emu, dump_frames, playing, hash_path, golden_path);
+
+    // Anything that jumps around in time would break the movie
+    bool movie_active = play_path || record_path;
+    if (movie_active) std::cout << "Rewind, state loading and reset are off during the movie\n";
+
+    // Open an audio device; the emulator still runs silently without one
+    AudioOutput audio;
+    if (audio.open(48000)) {
+        apu.set_sample_rate(audio.get_rate());
+        apu.set_output_enabled(true);
+    } else {
+        std::cout << "Audio device could not be opened: " << SDL_GetError() << std::endl;
+    }
+
+    // Main emulation loop: one frame per iteration
+    SaveState save;
+    SaveState ahead_save;
+    u8 shown[144 * 160]; // Run-ahead's picture, kept over the restore
+    RewindBuffer rewind;
+    u64 frames = 0;
+    u64 movie_frame = 0;
     while (!event_handler.quit_requested()) {
-    
-        // Fetch, decode, and execute an instruction
-        if (!cpu.step()) {
+
+        // Step back through history one snapshot per displayed frame
+        if (rewind_interval > 0 && !movie_active && event_handler.rewind_held()) {
+            if (rewind.pop(save)) emu.load_state(save);
+            ppu.render_frame();
+            continue;
+        }
+
+        // Input for the real frame comes from, or goes into, the movie
+        if (playing) {
+            if (movie_frame == movie.frames()) {
+                if (movie.has_end()) {
+                    std::cout << (movie.matches_end(emu) ? "Movie finished in sync\n"
+                                                         : "Movie finished out of sync\n");
+                } else {
+                    std::cout << "Movie finished\n";
+                }
+                playing = nullptr;
+                movie_active = false;
+            } else {
+                emu.set_joypad(movie.input(movie_frame));
+            }
+        } else {
+            // Keys only reach the game here, between frames, as they
+            // would from a movie
+            emu.set_joypad(event_handler.get_held());
+            if (record_path) movie.record(emu, emu.get_joypad());
+        }
+        movie_frame++;
+
+        bool stepped = true;
+        if (run_ahead > 0) {
+            // Emulate the real frame without drawing it
+            ppu.set_render_enabled(false);
+            stepped = emu.run_frame();
+            if (audio.is_open()) output_audio(apu, audio);
+
+            // Peek ahead with the latest input and only show the last frame,
+            // then go back. Frames that get thrown away aren't heard either.
+            emu.save_state(ahead_save);
+            apu.set_output_enabled(false);
+            for (int i = 1; i <= run_ahead && stepped; i++) {
+                ppu.set_render_enabled(i == run_ahead);
+                stepped = emu.run_frame();
+            }
+
+            // The real frame was never drawn, so the picture shown carries
+            // on into save states, rewind history and rewind playback
+            memcpy(shown, ppu.get_lcd_buf(), sizeof(shown));
+            emu.load_state(ahead_save);
+            ppu.set_lcd_buf(shown);
+            apu.set_output_enabled(audio.is_open());
+        } else {
+            stepped = emu.run_frame();
+            if (audio.is_open()) output_audio(apu, audio);
+        }
+
+        if (!stepped) {
             std::cout << "CPU could not step\n";
             return -2;
         }
+
+        // Save states are taken between frames
+        if (event_handler.save_state_requested()) {
+            emu.save_state(save);
+            if (save.save_file(state_path.c_str()))
+                std::cout << "Saved state to " << state_path << std::endl;
+        }
+        if (event_handler.load_state_requested() && !movie_active) {
+            if (save.load_file(state_path.c_str()) && emu.load_state(save))
+                std::cout << "Loaded state from " << state_path << std::endl;
+        }
+        if (event_handler.reset_requested() && !movie_active) {
+            emu.reset();
+            std::cout << "Game reset\n";
+        }
+
+        // Capture rewind history once every few frames
+        if (rewind_interval > 0 && !movie_active && ++frames % rewind_interval == 0) {
+            emu.save_state(save);
+            rewind.push(save);
+        }
        
     }
 
+    if (record_path) {
+        movie.finish(emu);
+        if (movie.save_file(record_path))
+            std::cout << "Saved movie to " << record_path << std::endl;
+    }
+
     // Create a SAV file when supported
     switch (cart.get_type()) {
         case 0x03: // MBC1+RAM+BATTERY
@@ -57,6 +392,8 @@ int main(int argc, char** argv) {
                 std::cout << "Game state could not be saved\n";
     }
 
+    audio.close();
+
     // ppu.print_vram();
     // ppu.print_oam();
     
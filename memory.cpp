@@ -1,120 +1,149 @@
 #include "memory.h"
 
-MemoryBus::MemoryBus(Cartridge &cart_, IO &io_, PPU &ppu_) : cart(cart_), io(io_), ppu(ppu_) {}
+MemoryBus::MemoryBus(MachineState &state_, Cartridge &cart_, IO &io_, PPU &ppu_, Timer &timer_) 
+    : state(state_), cart(cart_), io(io_), ppu(ppu_), timer(timer_) {}
 MemoryBus::~MemoryBus() {}
 
+void MemoryBus::reset() {
+    ram.reset();
+    cart.reset();
+}
+
 u8 MemoryBus::read(u16 addr) {
     if (addr < 0x8000) {
         // Reading from ROM
+        GB_COUNT(bus_reads[Region_ROM]);
         return cart.read(addr);
 
     } else if (addr < 0xA000) {
         // Reading from VRAM
+        GB_COUNT(bus_reads[Region_VRAM]);
         return ppu.vram_read(addr);
 
     } else if (addr < 0xC000) {
         // Reading from Cartridge RAM
+        GB_COUNT(bus_reads[Region_ERAM]);
         return cart.read(addr);
 
     } else if (addr < 0xE000) {
         // Reading from WRAM
+        GB_COUNT(bus_reads[Region_WRAM]);
         return ram.wram_read(addr);
 
     } else if (addr < 0xFE00) {
         // Echo RAM is reserved
+        GB_COUNT(bus_reads[Region_Echo]);
         std::cout << "Echo ram: reading prohibited area at: 0x" << std::hex << addr << std::endl;
         return 0;
 
     } else if (addr < 0xFEA0) {
         // Reading from OAM
+        GB_COUNT(bus_reads[Region_OAM]);
         return ppu.oam_read(addr);
 
     } else if (addr < 0xFF00) {
         // Not usable
+        GB_COUNT(bus_reads[Region_Unusable]);
         std::cout << "Not usable: reading prohibited area at: 0x" << std::hex << addr << std::endl;
         return 0;
 
     } else if (addr < 0xFF80) {
         // Reading from I/O registers
+        GB_COUNT(bus_reads[Region_IO]);
         return io.read(addr);
 
     } else if (addr == 0xFFFF) {
         // Reading IE register
-        return io.get_IE();
+        GB_COUNT(bus_reads[Region_IE]);
+        return state.IE;
         
     }
 
     // Reading from HRAM
+    GB_COUNT(bus_reads[Region_HRAM]);
     return ram.hram_read(addr);
 }
 
 void MemoryBus::write(u16 addr, u8 val) {
     if (addr < 0x8000) {
         // Writing to ROM
+        GB_COUNT(bus_writes[Region_ROM]);
         cart.write(addr, val);
 
     } else if (addr < 0xA000) {
         // Writing to VRAM
+        GB_COUNT(bus_writes[Region_VRAM]);
         ppu.vram_write(addr, val);
 
     } else if (addr < 0xC000) {
         // Writing to Cartridge RAM
+        GB_COUNT(bus_writes[Region_ERAM]);
         cart.write(addr, val);
 
     } else if (addr < 0xE000) {
         // Writing to WRAM
+        GB_COUNT(bus_writes[Region_WRAM]);
         ram.wram_write(addr, val);
   
     } else if (addr < 0xFE00) {
         // Echo RAM is reserved
+        GB_COUNT(bus_writes[Region_Echo]);
         std::cout << "Echo ram: writing to prohibited area at: 0x" << std::hex << addr << std::endl;
      
     } else if (addr < 0xFEA0) {
         // Writing to OAM
+        GB_COUNT(bus_writes[Region_OAM]);
         ppu.oam_write(addr, val);
        
     } else if (addr < 0xFF00) {
         // Not usable
+        GB_COUNT(bus_writes[Region_Unusable]);
         std::cout << "Not usable: writing to prohibited area at: 0x" << std::hex << addr << std::endl;
        
     } else if (addr < 0xFF80) {
         // Writing to I/O registers
+        GB_COUNT(bus_writes[Region_IO]);
         if (addr == 0xFF46) dma_transfer(val);
         else io.write(addr, val);
         
     } else if (addr == 0xFFFF) {
         // Setting IE register
-        io.set_IE(val);
+        GB_COUNT(bus_writes[Region_IE]);
+        state.IE = val;
         
     } else {
         // Writing to HRAM
+        GB_COUNT(bus_writes[Region_HRAM]);
         ram.hram_write(addr, val);
 
     }
 
 }
 
-u8 MemoryBus::get_IF() {
-    return io.get_IF();
-}
-
-void MemoryBus::set_IF(u8 val) {
-    io.set_IF(val);
-}
-
-u8 MemoryBus::get_IE() {
-    return io.get_IE();
+u8 MemoryBus::peek(u16 addr) {
+    // The same map as read, prohibited areas reading 0
+    if (addr < 0x8000) return cart.read(addr);
+    if (addr < 0xA000) return ppu.vram_read(addr);
+    if (addr < 0xC000) return cart.read(addr);
+    if (addr < 0xE000) return ram.wram_read(addr);
+    if (addr < 0xFE00) return 0;
+    if (addr < 0xFEA0) return ppu.oam_read(addr);
+    if (addr < 0xFF00) return 0;
+    if (addr < 0xFF80) return io.peek(addr);
+    if (addr == 0xFFFF) return state.IE;
+    return ram.hram_read(addr);
 }
 
 void MemoryBus::emulate_cycles(int cpu_cycles) {
 
     // There are 4 "T-cycles" in each "M-cycle"
     int system_clock_ticks = 4 * cpu_cycles; 
+    state.cycles += system_clock_ticks;
 
     for (int i = 0; i < system_clock_ticks; i++ ) {
 
-        if (io.timer_tick()) { // Timer requested an interrupt
-            io.set_IF(io.get_IF() | 0b100); 
+        if (timer.tick()) { // Timer requested an interrupt
+            state.IF |= 0b100; 
         }
 
         ppu.step();
@@ -122,6 +151,10 @@ void MemoryBus::emulate_cycles(int cpu_cycles) {
     }
 }
 
+u16 MemoryBus::code_bank(u16 addr) {
+    return (addr >= 0x4000 && addr < 0x8000) ? cart.get_rom_bank() : 0;
+}
+
 void MemoryBus::dma_transfer(u8 val) {
     // std::cout << "Starting OAM DMA transfer" << std::endl;
     u16 offset = ((u16)val) << 8;
@@ -130,7 +163,44 @@ void MemoryBus::dma_transfer(u8 val) {
     }
 }
 
-RAM::RAM() {}
+void MemoryBus::serialize(SaveState &save) {
+    save.cart_type = cart.get_type();
+    save.rom_checksum = cart.get_checksum();
+
+    // Registers, timer and LCD state come over in one block
+    save.machine = state;
+
+    io.serialize(save);
+    ram.serialize(save);
+    ppu.serialize(save);
+    cart.serialize(save);
+}
+
+bool MemoryBus::deserialize(const SaveState &save) {
+    if (!save.valid()) {
+        std::cout << "Save state has an unsupported format\n";
+        return false;
+    }
+
+    // A state only makes sense for the game it was taken from
+    if (save.cart_type != cart.get_type() || save.rom_checksum != cart.get_checksum()) {
+        std::cout << "Save state belongs to a different game\n";
+        return false;
+    }
+
+    state = save.machine;
+
+    io.deserialize(save);
+    ram.deserialize(save);
+    ppu.deserialize(save);
+    cart.deserialize(save);
+
+    return true;
+}
+
+RAM::RAM() {
+    reset();
+}
 RAM::~RAM() {}
 
 u8 RAM::wram_read(u16 addr) {
@@ -157,30 +227,69 @@ void RAM::hram_write(u16 addr, u8 val) {
     hram[addr] = val;
 }
 
-Cartridge::Cartridge() : rom_data(nullptr) {}
-Cartridge::~Cartridge() { if (rom_data) delete[] rom_data; }
+void RAM::reset() {
+    memset(wram, 0, sizeof(wram));
+    memset(hram, 0, sizeof(hram));
+}
 
-bool Cartridge::load_rom(char *ROM) {
+void RAM::serialize(SaveState &save) {
+    memcpy(save.ram.wram, wram, sizeof(wram));
+    memcpy(save.ram.hram, hram, sizeof(hram));
+}
 
-    // Open ROM file
-    std::ifstream ifs;
-    ifs.open(ROM);
-    if (ifs.fail()) {
-        std::cout << "ROM failed to open\n";
+void RAM::deserialize(const SaveState &save) {
+    memcpy(wram, save.ram.wram, sizeof(wram));
+    memcpy(hram, save.ram.hram, sizeof(hram));
+}
+
+Cartridge::Cartridge() : rom_data(nullptr) {
+    clear_ram();
+}
+Cartridge::~Cartridge() {}
+
+void Cartridge::reset() {
+    enable_ram = false;
+    rom_bank_num = 0x01;
+    ram_bank_num = 0x00;
+    mode_flag = 0;
+}
+
+void Cartridge::clear_ram() {
+    memset(sram, 0, sizeof(sram));
+}
+
+bool Cartridge::load_rom(const char *ROM) {
+    // Mapped, and shared with any other instance running the same game
+    return attach(RomRegistry::instance().open(ROM));
+}
+
+bool Cartridge::load_rom(const u8 *data, u32 size) {
+    return attach(RomRegistry::instance().share(data, size));
+}
+
+bool Cartridge::attach(std::shared_ptr<RomImage> image) {
+    if (!image) return false;
+
+    // Anything shorter can't even hold the header
+    if (image->get_size() < 0x150) {
+        std::cout << "ROM is too small\n";
         return false;
     }
 
-    // Figure out ROM size
-    ifs.seekg(0, std::ios::end);
-    u32 size = ifs.tellg();
+    // Banked reads trust the header, so the file has to be at least that big
+    const u8 *data = image->get_data();
+    if (data[0x148] > 0x08 || image->get_size() < (0x8000u << data[0x148])) {
+        std::cout << "ROM is smaller than its header says\n";
+        return false;
+    }
 
-    // Rewind back to beginning of ROM file
-    ifs.seekg(0, std::ios::beg);
-    
-    // Load ROM data into Cartridge
-    rom_data = new u8[size];
-    ifs.read((char*)rom_data, size);
-    ifs.close();
+    // Replaces any earlier ROM, which is released once nobody uses it
+    rom = image;
+    rom_data = data;
+
+    // A different cartridge comes with its own, empty, RAM
+    clear_ram();
+    reset();
 
     cart_type = rom_data[0x147];
     rom_size = 32 * (1 << (u32)rom_data[0x148]);
@@ -191,6 +300,7 @@ bool Cartridge::load_rom(char *ROM) {
         case 0x03: ram_size = 32; break;
         case 0x04: ram_size = 128; break;
         case 0x05: ram_size = 64; break;
+        default: ram_size = 0; break;
     }
 
     std::cout << "Game cartridge loaded\n";
@@ -201,7 +311,17 @@ bool Cartridge::load_rom(char *ROM) {
     return true;
 }
 
+void Cartridge::share_rom(const Cartridge &other) {
+    // Already checked when other loaded it, so this is quick and quiet
+    rom = other.rom;
+    rom_data = other.rom_data;
+    cart_type = other.cart_type;
+    rom_size = other.rom_size;
+    ram_size = other.ram_size;
+}
+
 bool Cartridge::save_state(char *SAV) {
+    TRACE_ZONE("SAV write");
     std::ofstream ofs;
 
     // Create a new save file
@@ -226,6 +346,7 @@ bool Cartridge::save_state(char *SAV) {
 }
 
 bool Cartridge::load_state(char *SAV) {
+    TRACE_ZONE("SAV read");
     std::ifstream ifs;
 
     if (!SAV) {
@@ -253,6 +374,47 @@ u8 Cartridge::get_type() {
     return cart_type;
 }
 
+u16 Cartridge::get_rom_bank() {
+    switch (cart_type) {
+        case 0x01:
+        case 0x02:
+        case 0x03:
+            // MBC1 maps banks 0x00/0x20/0x40/0x60 one higher
+            return (rom_bank_num & 0x1F) == 0 ? rom_bank_num + 1 : rom_bank_num;
+        case 0x11:
+        case 0x12:
+        case 0x13:
+            return rom_bank_num;
+    }
+    return 1;
+}
+
+std::shared_ptr<RomImage> Cartridge::get_rom() {
+    return rom;
+}
+
+u16 Cartridge::get_checksum() {
+    // Global checksum from the cartridge header (big endian)
+    return ((u16)rom_data[0x14E] << 8) | rom_data[0x14F];
+}
+
+void Cartridge::serialize(SaveState &save) {
+    save.cart.rom_bank_num = rom_bank_num;
+    save.cart.ram_bank_num = ram_bank_num;
+    save.cart.enable_ram = enable_ram;
+    save.cart.mode_flag = mode_flag;
+    memcpy(save.cart.sram, sram, sizeof(sram));
+}
+
+void Cartridge::deserialize(const SaveState &save) {
+    // A damaged state must not point past the end of the ROM or SRAM
+    rom_bank_num = save.cart.rom_bank_num & (rom_size / 16 - 1);
+    ram_bank_num = save.cart.ram_bank_num & 0b11;
+    enable_ram = save.cart.enable_ram;
+    mode_flag = save.cart.mode_flag;
+    memcpy(sram, save.cart.sram, sizeof(sram));
+}
+
 u8 Cartridge::read(u16 addr) {
     switch (cart_type) {
         case 0x00: // No MBC
@@ -351,6 +513,10 @@ u8 Cartridge::read(u16 addr) {
 }
 
 void Cartridge::write(u16 addr, u8 val) {
+#ifdef GB_COUNTERS
+    u8 rom_bank = rom_bank_num, ram_bank = ram_bank_num;
+#endif
+
     switch (cart_type) {
         case 0x00: break; // No MBC -> no writes
 
@@ -389,13 +555,13 @@ void Cartridge::write(u16 addr, u8 val) {
                 // ROM Bank Number
                 // std::cout << "Setting ROM bank number: 0x";
                 if (val == 0x00) { 
-                    rom_bank_num = 0x01;
+                    rom_bank_num = (rom_bank_num & (0b11 << 5)) | 0x01;
                     // std::cout << "00 -> 0x0" << std::hex << +rom_bank_num << std::endl;
                     break;
                 }
 
                 // Only need n bits to represent 2^n ROM banks
-                u8 bit_mask;
+                u8 bit_mask = 0b11111;
                 switch (rom_size) {
                     case 2048:
                     case 1024:
@@ -408,7 +574,8 @@ void Cartridge::write(u16 addr, u8 val) {
                     case 32: bit_mask = 0b1; break; 
                 }
                 
-                rom_bank_num = val & bit_mask;
+                // Upper bits come from 0x4000 - 0x5FFF and stay as they are
+                rom_bank_num = (rom_bank_num & (0b11 << 5)) | (val & bit_mask);
 
                 // std::cout << std::hex << +rom_bank_num << " using bit mask 0x" << +bit_mask << std::endl;
 
@@ -420,7 +587,7 @@ void Cartridge::write(u16 addr, u8 val) {
                 }
                 if (rom_size >= 1024) {
                     // Need more bits to represent ROM banks
-                    rom_bank_num += ((val & 0b11) << 5);
+                    rom_bank_num = (rom_bank_num & 0b11111) | ((val & 0b11) << 5);
                 }
 
             } else if (addr <= 0x7FFF) {
@@ -473,4 +640,12 @@ void Cartridge::write(u16 addr, u8 val) {
             
             break;
     }
+
+    // Only as many banks as the ROM has; higher bank numbers wrap around
+    rom_bank_num &= rom_size / 16 - 1;
+
+#ifdef GB_COUNTERS
+    if (rom_bank_num != rom_bank) GB_COUNT(rom_bank_switches);
+    if (ram_bank_num != ram_bank) GB_COUNT(ram_bank_switches);
+#endif
 }
\ No newline at end of file
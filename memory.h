@@ -4,28 +4,44 @@
 #include "common.h"
 #include "ppu.h"
 #include "io.h"
+#include "timer.h"
+#include "machine_state.h"
+#include "save_state.h"
+#include "rom.h"
+#include "counters.h"
 
 class Cartridge {
     private:
-        u8 *rom_data;
+        std::shared_ptr<RomImage> rom;
+        const u8 *rom_data; // Same as rom->get_data(), for the hot paths
         u8 sram[0x2000 * 4];
-        u32 rom_size; // in KB
-        u16 ram_size; // in KB
-        u8 cart_type;
+        u32 rom_size = 0; // in KB
+        u16 ram_size = 0; // in KB
+        u8 cart_type = 0;
         bool enable_ram = false;
         u8 rom_bank_num = 0x01;
         u8 ram_bank_num = 0x00;
-        bool mode_flag;
+        bool mode_flag = 0;
 
     public:
         Cartridge();
         ~Cartridge();
-        bool load_rom(char *ROM);
+        void reset(); // MBC registers only; battery-backed RAM survives
+        void clear_ram();
+        bool load_rom(const char *ROM);
+        bool load_rom(const u8 *data, u32 size);
+        bool attach(std::shared_ptr<RomImage> image);
+        void share_rom(const Cartridge &other);
         bool save_state(char *SAV = nullptr);
         bool load_state(char *SAV);
         u8 get_type();
+        u16 get_rom_bank(); // Bank mapped at 0x4000 - 0x7FFF
+        u16 get_checksum();
+        std::shared_ptr<RomImage> get_rom();
         u8 read(u16 addr);
         void write(u16 addr, u8 val);
+        void serialize(SaveState &save);
+        void deserialize(const SaveState &save);
 };
 
 class RAM {
@@ -35,31 +51,39 @@ class RAM {
     public:
         RAM();
         ~RAM();
+        void reset();
         u8 wram_read(u16 addr);
         void wram_write(u16 addr, u8 val);
         u8 hram_read(u16 addr);
         void hram_write(u16 addr, u8 val);
+        void serialize(SaveState &save);
+        void deserialize(const SaveState &save);
 };
 
 class MemoryBus {
     private:
+        MachineState &state;
         Cartridge &cart;
         IO &io;
         PPU &ppu;
+        Timer &timer;
         RAM ram;
 
     public:
-        MemoryBus(Cartridge &cart_, IO &io_, PPU &ppu_);
+        MemoryBus(MachineState &state_, Cartridge &cart_, IO &io_, PPU &ppu_, Timer &timer_);
         ~MemoryBus();
+        void reset(); // Work RAM and cartridge; the rest reset themselves
         u8 read(u16 addr);
         void write(u16 addr, u8 val);
-        u8 get_IF();
-        void set_IF(u8 val);
-        u8 get_IE();
+        u8 peek(u16 addr); // read without counting, printing or catching anything up
 
         void emulate_cycles(int cpu_cycles); // For cycle timing
 
         void dma_transfer(u8 val);
+        u16 code_bank(u16 addr); // ROM bank addr reads from, 0 outside 0x4000 - 0x7FFF
+
+        void serialize(SaveState &save);
+        bool deserialize(const SaveState &save);
 };
 
 #endif
\ No newline at end of file
@@ -0,0 +1,231 @@
+#include "movie.h"
+#include "rom.h"
+
+const u32 MOVIE_MAGIC = 0x564D4247; // "GBMV"
+const u32 MOVIE_VERSION = 2;
+const u64 MAX_FRAMES = 1ull << 28; // Over 50 days at 60 frames/s, 256 MB of masks
+
+// Leads the file. The start SaveState and the encoded inputs follow,
+// then every keyframe as its frame number and its SaveState.
+struct MovieHeader {
+    u32 magic;
+    u32 version;
+    u32 rom_crc;
+    u32 rom_size;
+    u32 end_crc;
+    u32 state_size;
+    u32 flags;    // Bit 0: end_crc is set
+    u32 keyframes;
+    u64 frames;
+};
+
+u32 state_crc(Emulator &emu) {
+    std::unique_ptr<SaveState> save(new SaveState());
+    emu.save_state(*save);
+    return state_crc(*save);
+}
+
+u32 state_crc(const SaveState &save) {
+    return crc32((const u8*)&save, sizeof(SaveState));
+}
+
+Movie::Movie() {}
+
+Movie::~Movie() {}
+
+bool Movie::begin(Emulator &emu) {
+    std::shared_ptr<RomImage> rom = emu.get_cart().get_rom();
+    if (!rom) return false;
+
+    rom_crc = rom->get_crc();
+    rom_size = rom->get_size();
+    finished = false;
+    start.reset(new SaveState());
+    emu.save_state(*start);
+    inputs.clear();
+    keyframes.clear();
+    return true;
+}
+
+void Movie::record(Emulator &emu, u8 pressed) {
+    u64 frame = inputs.size();
+    if (keyframe_interval > 0 && frame > 0 && frame % keyframe_interval == 0) {
+        Keyframe key = {frame, std::unique_ptr<SaveState>(new SaveState())};
+        emu.save_state(*key.state);
+        keyframes.push_back(std::move(key));
+    }
+    inputs.push_back(pressed);
+}
+
+void Movie::finish(Emulator &emu) {
+    end_crc = state_crc(emu);
+    finished = true;
+}
+
+void Movie::set_keyframe_interval(u64 frames) {
+    keyframe_interval = frames;
+}
+
+bool Movie::matches_rom(Emulator &emu) {
+    std::shared_ptr<RomImage> rom = emu.get_cart().get_rom();
+    if (!rom) return false;
+
+    if (rom->get_crc() != rom_crc || rom->get_size() != rom_size) {
+        std::cout << "Movie was recorded with a different ROM\n";
+        return false;
+    }
+    return true;
+}
+
+bool Movie::rewind(Emulator &emu) {
+    if (!start || !matches_rom(emu)) return false;
+    return emu.load_state(*start);
+}
+
+bool Movie::matches_end(Emulator &emu) {
+    return state_crc(emu) == end_crc;
+}
+
+bool Movie::save_file(const char *path) {
+    if (!start) return false;
+
+    std::ofstream ofs;
+    ofs.open(path, std::ios::binary);
+    if (ofs.fail()) {
+        std::cout << "Movie file failed to be created\n";
+        return false;
+    }
+
+    MovieHeader header = {MOVIE_MAGIC, MOVIE_VERSION, rom_crc, rom_size, end_crc,
+                          sizeof(SaveState), finished, (u32)keyframes.size(), inputs.size()};
+    ofs.write((char*)&header, sizeof(header));
+    ofs.write((char*)start.get(), sizeof(SaveState));
+
+    // Runs of one mask: the mask, then the run length 7 bits a byte
+    std::vector<u8> encoded;
+    for (size_t i = 0; i < inputs.size();) {
+        size_t run = 1;
+        while (i + run < inputs.size() && inputs[i + run] == inputs[i]) run++;
+        encoded.push_back(inputs[i]);
+        for (u64 n = run; ; n >>= 7) {
+            encoded.push_back((n & 0x7F) | (n >= 0x80 ? 0x80 : 0));
+            if (n < 0x80) break;
+        }
+        i += run;
+    }
+    ofs.write((char*)encoded.data(), encoded.size());
+
+    for (const Keyframe &key : keyframes) {
+        ofs.write((char*)&key.frame, sizeof(key.frame));
+        ofs.write((char*)key.state.get(), sizeof(SaveState));
+    }
+    ofs.close();
+
+    if (ofs.fail()) {
+        std::cout << "Movie file could not be written\n";
+        return false;
+    }
+    return true;
+}
+
+bool Movie::load_file(const char *path) {
+    std::ifstream ifs;
+    ifs.open(path, std::ios::binary);
+    if (ifs.fail()) {
+        std::cout << "Movie file failed to open\n";
+        return false;
+    }
+
+    MovieHeader header;
+    std::unique_ptr<SaveState> state(new SaveState());
+    ifs.read((char*)&header, sizeof(header));
+    ifs.read((char*)state.get(), sizeof(SaveState));
+    if (!ifs || header.magic != MOVIE_MAGIC || header.version != MOVIE_VERSION
+        || header.state_size != sizeof(SaveState) || !state->valid()) {
+        std::cout << "Movie file is not a compatible movie\n";
+        return false;
+    }
+
+    // A few bytes of runs can stand for any number of frames, so the
+    // count is only trusted up to a limit and the masks grow as they decode
+    if (header.frames > MAX_FRAMES) {
+        std::cout << "Movie file is too long\n";
+        return false;
+    }
+
+    // Inputs end once every frame is accounted for
+    std::vector<u8> decoded;
+    while (decoded.size() < header.frames) {
+        int mask = ifs.get();
+        u64 run = 0;
+        for (int shift = 0; shift < 64; shift += 7) {
+            int byte = ifs.get();
+            if (byte == EOF) break;
+            run |= (u64)(byte & 0x7F) << shift;
+            if (!(byte & 0x80)) break;
+        }
+        if (mask == EOF || run == 0 || run > header.frames - decoded.size()) break;
+        decoded.insert(decoded.end(), run, mask);
+    }
+
+    if (decoded.size() != header.frames) {
+        std::cout << "Movie file is truncated\n";
+        return false;
+    }
+
+    // Keyframes come in order, each inside the movie, and all of them
+    // have to be there before any room is made for them
+    std::streampos keys_start = ifs.tellg();
+    ifs.seekg(0, std::ios::end);
+    u64 remaining = ifs.tellg() - keys_start;
+    ifs.seekg(keys_start);
+    if ((u64)header.keyframes * (sizeof(u64) + sizeof(SaveState)) > remaining) {
+        std::cout << "Movie file has a damaged keyframe\n";
+        return false;
+    }
+    std::vector<Keyframe> keys(header.keyframes);
+    u64 last = 0;
+    for (Keyframe &key : keys) {
+        key.state.reset(new SaveState());
+        ifs.read((char*)&key.frame, sizeof(key.frame));
+        ifs.read((char*)key.state.get(), sizeof(SaveState));
+        if (!ifs || !key.state->valid() || key.frame <= last || key.frame >= header.frames) {
+            std::cout << "Movie file has a damaged keyframe\n";
+            return false;
+        }
+        last = key.frame;
+    }
+
+    rom_crc = header.rom_crc;
+    rom_size = header.rom_size;
+    end_crc = header.end_crc;
+    finished = header.flags & 1;
+    start = std::move(state);
+    inputs = std::move(decoded);
+    keyframes = std::move(keys);
+    return true;
+}
+
+u64 Movie::frames() {
+    return inputs.size();
+}
+
+u8 Movie::input(u64 frame) {
+    return frame < inputs.size() ? inputs[frame] : 0;
+}
+
+bool Movie::has_end() {
+    return finished;
+}
+
+u32 Movie::get_end_crc() {
+    return end_crc;
+}
+
+const SaveState &Movie::get_start() {
+    return *start;
+}
+
+const std::vector<Keyframe> &Movie::get_keyframes() {
+    return keyframes;
+}
@@ -0,0 +1,65 @@
+#ifndef MOVIE_H
+#define MOVIE_H
+
+#include "common.h"
+#include "emulator.h"
+#include <vector>
+
+// A recorded run: the ROM it belongs to, the full state it starts from
+// and the joypad for every frame after that.
+//
+// Input only ever changes between frames (the front end polls once per
+// frame, library users set it per frame), so one mask per frame replays
+// bit-exactly. On disk the masks are run-length encoded, since they
+// rarely change from one frame to the next. A CRC of the state the
+// recording ended in lets playback check that it got there too.
+//
+// Full states are also kept every so often while recording. Each one
+// starts a segment that can be replayed without the ones before it, and
+// ends the previous segment with a state to check it against.
+struct Keyframe {
+    u64 frame;                       // Taken before this frame's input
+    std::unique_ptr<SaveState> state;
+};
+
+class Movie {
+    private:
+        u32 rom_crc = 0;
+        u32 rom_size = 0;
+        u32 end_crc = 0;
+        bool finished = false;   // end_crc is known
+        std::unique_ptr<SaveState> start;
+        std::vector<u8> inputs;  // One joypad mask per frame
+        std::vector<Keyframe> keyframes;
+        u64 keyframe_interval = 3600; // Frames, 0 for none
+    public:
+        Movie();
+        ~Movie();
+
+        // Recording: start from where emu is now, add a mask before every
+        // frame, finish once the last one has run
+        bool begin(Emulator &emu);
+        void record(Emulator &emu, u8 pressed);
+        void finish(Emulator &emu);
+        void set_keyframe_interval(u64 frames);
+
+        // Playback: check the ROM and go to the start state
+        bool matches_rom(Emulator &emu);
+        bool rewind(Emulator &emu);
+        bool matches_end(Emulator &emu);
+
+        bool save_file(const char *path);
+        bool load_file(const char *path);
+
+        u64 frames();
+        u8 input(u64 frame);
+        bool has_end();
+        u32 get_end_crc();
+        const SaveState &get_start();
+        const std::vector<Keyframe> &get_keyframes();
+};
+
+u32 state_crc(Emulator &emu);
+u32 state_crc(const SaveState &save);
+
+#endif
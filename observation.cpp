@@ -0,0 +1,201 @@
+#include "observation.h"
+#include "ppu.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define OBS_X86
+#endif
+
+const int lcd_width = 160;
+const int lcd_height = 144;
+
+// Row kernels every instruction set provides. Colour IDs are below 16,
+// so one 16 entry table converts them to output values.
+struct ObsKernels {
+    void (*lut_row)(const u8 *ids, const u8 *lut, u8 *out, int n);
+    void (*add_row)(const u8 *in, u16 *acc, int n);
+    void (*max_row)(const u8 *in, u8 *acc, int n);
+};
+
+static void lut_row_scalar(const u8 *ids, const u8 *lut, u8 *out, int n) {
+    for (int i = 0; i < n; i++) out[i] = lut[ids[i] & 0xF];
+}
+
+static void add_row_scalar(const u8 *in, u16 *acc, int n) {
+    for (int i = 0; i < n; i++) acc[i] += in[i];
+}
+
+static void max_row_scalar(const u8 *in, u8 *acc, int n) {
+    for (int i = 0; i < n; i++) acc[i] = std::max(acc[i], in[i]);
+}
+
+#ifdef OBS_X86
+
+// SSE2 has no byte shuffle, so the table is applied as a compare and
+// select per colour ID in use
+static void lut_row_sse2(const u8 *ids, const u8 *lut, u8 *out, int n) {
+    int i = 0;
+    for (; i + 16 <= n; i += 16) {
+        __m128i v = _mm_loadu_si128((const __m128i*)(ids + i));
+        __m128i res = _mm_setzero_si128();
+        for (int id = 0; id <= None_Transparent; id++) {
+            __m128i hit = _mm_cmpeq_epi8(v, _mm_set1_epi8(id));
+            res = _mm_or_si128(res, _mm_and_si128(hit, _mm_set1_epi8(lut[id])));
+        }
+        _mm_storeu_si128((__m128i*)(out + i), res);
+    }
+    lut_row_scalar(ids + i, lut, out + i, n - i);
+}
+
+static void add_row_sse2(const u8 *in, u16 *acc, int n) {
+    int i = 0;
+    const __m128i zero = _mm_setzero_si128();
+    for (; i + 16 <= n; i += 16) {
+        __m128i v = _mm_loadu_si128((const __m128i*)(in + i));
+        __m128i *a = (__m128i*)(acc + i);
+        _mm_storeu_si128(a, _mm_add_epi16(_mm_loadu_si128(a), _mm_unpacklo_epi8(v, zero)));
+        _mm_storeu_si128(a + 1, _mm_add_epi16(_mm_loadu_si128(a + 1), _mm_unpackhi_epi8(v, zero)));
+    }
+    add_row_scalar(in + i, acc + i, n - i);
+}
+
+static void max_row_sse2(const u8 *in, u8 *acc, int n) {
+    int i = 0;
+    for (; i + 16 <= n; i += 16) {
+        __m128i v = _mm_loadu_si128((const __m128i*)(in + i));
+        __m128i *a = (__m128i*)(acc + i);
+        _mm_storeu_si128(a, _mm_max_epu8(_mm_loadu_si128(a), v));
+    }
+    max_row_scalar(in + i, acc + i, n - i);
+}
+
+// AVX2 looks the whole table up in one byte shuffle
+__attribute__((target("avx2")))
+static void lut_row_avx2(const u8 *ids, const u8 *lut, u8 *out, int n) {
+    int i = 0;
+    __m256i table = _mm256_broadcastsi128_si256(_mm_loadu_si128((const __m128i*)lut));
+    __m256i low = _mm256_set1_epi8(0xF);
+    for (; i + 32 <= n; i += 32) {
+        __m256i v = _mm256_loadu_si256((const __m256i*)(ids + i));
+        __m256i res = _mm256_shuffle_epi8(table, _mm256_and_si256(v, low));
+        _mm256_storeu_si256((__m256i*)(out + i), res);
+    }
+    lut_row_scalar(ids + i, lut, out + i, n - i);
+}
+
+__attribute__((target("avx2")))
+static void add_row_avx2(const u8 *in, u16 *acc, int n) {
+    int i = 0;
+    for (; i + 16 <= n; i += 16) {
+        __m256i v = _mm256_cvtepu8_epi16(_mm_loadu_si128((const __m128i*)(in + i)));
+        __m256i *a = (__m256i*)(acc + i);
+        _mm256_storeu_si256(a, _mm256_add_epi16(_mm256_loadu_si256(a), v));
+    }
+    add_row_scalar(in + i, acc + i, n - i);
+}
+
+__attribute__((target("avx2")))
+static void max_row_avx2(const u8 *in, u8 *acc, int n) {
+    int i = 0;
+    for (; i + 32 <= n; i += 32) {
+        __m256i v = _mm256_loadu_si256((const __m256i*)(in + i));
+        __m256i *a = (__m256i*)(acc + i);
+        _mm256_storeu_si256(a, _mm256_max_epu8(_mm256_loadu_si256(a), v));
+    }
+    max_row_scalar(in + i, acc + i, n - i);
+}
+
+#endif
+
+static ObsKernels pick_kernels() {
+#ifdef OBS_X86
+    if (__builtin_cpu_supports("avx2")) return {lut_row_avx2, add_row_avx2, max_row_avx2};
+    if (__builtin_cpu_supports("sse2")) return {lut_row_sse2, add_row_sse2, max_row_sse2};
+#endif
+    return {lut_row_scalar, add_row_scalar, max_row_scalar};
+}
+
+void make_observation(const u8 *lcd_buf, const u8 *map, const ObsSpec &spec, u8 *out) {
+    // Picked once; never changes afterwards, so sharing it across threads is fine
+    static const ObsKernels kernels = pick_kernels();
+
+    // Fold the output format into one colour ID table per channel
+    const int channels = spec.channels();
+    alignas(16) u8 lut[3][16] = {{0}};
+    for (int id = 0; id <= None_Transparent; id++) {
+        u8 shade = map[id] & 0b11;
+        for (int c = 0; c < channels; c++) {
+            switch (spec.format) {
+                case Obs_Shades: lut[c][id] = shade; break;
+                case Obs_Gray: lut[c][id] = 255 - 85 * shade; break;
+                case Obs_RGB: lut[c][id] = PPU::palette[shade][c]; break;
+            }
+        }
+    }
+
+    // Source columns for every output column, worked out once per call.
+    // Output rows cover either min_rows or min_rows + 1 source rows, so the
+    // box averages only need reciprocals for those two. ceil(2^40 / count)
+    // divides exactly while count times the largest rounded sum stays under
+    // 2^40; at most that is 23040 * 255 * 23040, about 2^37.
+    const int min_rows = std::max(1, lcd_height / spec.height);
+    u8 near_x[lcd_width];
+    u8 span_x0[lcd_width];
+    u8 span_x1[lcd_width];
+    u64 recip[2][lcd_width];
+    for (int x = 0; x < spec.width; x++) {
+        near_x[x] = (2 * x + 1) * lcd_width / (2 * spec.width);
+        span_x0[x] = x * lcd_width / spec.width;
+        span_x1[x] = std::max(span_x0[x] + 1, (x + 1) * lcd_width / spec.width);
+        for (int extra = 0; extra < 2; extra++) {
+            u64 count = (span_x1[x] - span_x0[x]) * (min_rows + extra);
+            recip[extra][x] = ((1ull << 40) + count - 1) / count;
+        }
+    }
+
+    u8 row[lcd_width];
+    u16 sum[lcd_width];
+    u8 peak[lcd_width];
+
+    for (int y = 0; y < spec.height; y++) {
+        // Source rows this output row covers
+        int sy0 = y * lcd_height / spec.height;
+        int sy1 = std::max(sy0 + 1, (y + 1) * lcd_height / spec.height);
+
+        for (int c = 0; c < channels; c++) {
+            u8 *dst = out + y * spec.width * channels + c;
+
+            if (spec.filter == Obs_Nearest) {
+                // Only a few pixels per row are used, so look them up directly
+                const u8 *src = lcd_buf + ((2 * y + 1) * lcd_height / (2 * spec.height)) * lcd_width;
+                for (int x = 0; x < spec.width; x++) {
+                    dst[x * channels] = lut[c][src[near_x[x]] & 0xF];
+                }
+                continue;
+            }
+
+            // Reduce the covered rows down to one, then across each span
+            if (spec.filter == Obs_Box) memset(sum, 0, sizeof(sum));
+            else memset(peak, 0, sizeof(peak));
+            for (int sy = sy0; sy < sy1; sy++) {
+                kernels.lut_row(lcd_buf + sy * lcd_width, lut[c], row, lcd_width);
+                if (spec.filter == Obs_Box) kernels.add_row(row, sum, lcd_width);
+                else kernels.max_row(row, peak, lcd_width);
+            }
+
+            const u64 *row_recip = recip[sy1 - sy0 - min_rows];
+            for (int x = 0; x < spec.width; x++) {
+                if (spec.filter == Obs_Box) {
+                    u32 total = 0;
+                    for (int sx = span_x0[x]; sx < span_x1[x]; sx++) total += sum[sx];
+                    u32 count = (span_x1[x] - span_x0[x]) * (sy1 - sy0);
+                    dst[x * channels] = ((total + count / 2) * row_recip[x]) >> 40;
+                } else {
+                    u8 best = 0;
+                    for (int sx = span_x0[x]; sx < span_x1[x]; sx++) best = std::max(best, peak[sx]);
+                    dst[x * channels] = best;
+                }
+            }
+        }
+    }
+}
@@ -0,0 +1,37 @@
+#ifndef OBSERVATION_H
+#define OBSERVATION_H
+
+#include "common.h"
+
+typedef enum {
+    Obs_Shades, // 0 (lightest) to 3
+    Obs_Gray,   // 255 (lightest) to 0
+    Obs_RGB     // Interleaved RGB in the display palette, 3 bytes a pixel
+} obs_format;
+
+typedef enum {
+    Obs_Nearest, // Sample the middle of each output pixel
+    Obs_Box,     // Average every source pixel an output pixel covers
+    Obs_Max      // Largest value an output pixel covers
+} obs_filter;
+
+// How frames are handed to agents
+struct ObsSpec {
+    int width = 160;
+    int height = 144;
+    obs_format format = Obs_Gray;
+    obs_filter filter = Obs_Nearest;
+
+    int channels() const { return format == Obs_RGB ? 3 : 1; }
+    int size() const { return width * height * channels(); }
+};
+
+// Converts a 160x144 buffer of colour IDs straight into the caller's
+// buffer in one pass. map gives the shade of every colour ID, so palette
+// lookup and output format fold into a single table per channel.
+//
+// Rows are converted and reduced with SSE2 or AVX2, whichever the CPU
+// has, with a scalar fallback; the choice is made once at first use.
+void make_observation(const u8 *lcd_buf, const u8 *map, const ObsSpec &spec, u8 *out);
+
+#endif
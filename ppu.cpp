@@ -1,23 +1,30 @@
 #include "ppu.h"
 
-PPU::PPU(IO &io_, EventHandler &event_handler_) 
-    : io(io_), event_handler(event_handler_) {
-    SDL_Init(SDL_INIT_VIDEO);
-
-    // Set up display
-    lcd = SDL_CreateWindow("gb-emu",
-        SDL_WINDOWPOS_CENTERED, SDL_WINDOWPOS_CENTERED,
-        lcd_width * lcd_scale, lcd_height * lcd_scale, 0);
-    renderer = SDL_CreateRenderer(lcd, -1, SDL_RENDERER_ACCELERATED);
-
-    for (int y = 0; y < lcd_height; y++) {
-        for (int x = 0; x < lcd_width; x++) {
-            lcd_buf[y][x] = BGW_ID_0;
-        }
+const u8 PPU::palette[4][3] = {
+    {154, 158, 63}, // "White"
+    {73, 107, 34},  // "Light gray"
+    {14, 69, 11},   // "Dark gray"
+    {27, 42, 9}     // "Black"
+};
+
+PPU::PPU(MachineState &state_, EventHandler &event_handler_, bool headless_) 
+    : headless(headless_), state(state_), event_handler(event_handler_) {
+    if (!headless) {
+        SDL_Init(SDL_INIT_VIDEO);
+
+        // Set up display
+        lcd = SDL_CreateWindow("gb-emu",
+            SDL_WINDOWPOS_CENTERED, SDL_WINDOWPOS_CENTERED,
+            lcd_width * lcd_scale, lcd_height * lcd_scale, 0);
+        renderer = SDL_CreateRenderer(lcd, -1, SDL_RENDERER_ACCELERATED);
     }
+
+    reset();
 }
 
 PPU::~PPU() {
+    if (headless) return;
+
     SDL_DestroyRenderer(renderer);
     SDL_DestroyWindow(lcd);
     lcd = nullptr;
@@ -26,73 +33,87 @@ PPU::~PPU() {
     SDL_Quit();
 }
 
+void PPU::reset() {
+    memset(vram, 0, sizeof(vram));
+    memset(oam, 0, sizeof(oam));
+    memset(lcd_buf, BGW_ID_0, sizeof(lcd_buf));
+    sprite_buffer.clear();
+    frame_count = 0;
+    next_frame_time = 0; // Pacing starts over from the next frame
+}
+
 void PPU::step() {
 
-    u8 lcd_enabled = BIT(io.get_LCDC(), 7);
+    u8 lcd_enabled = BIT(state.LCDC, 7);
     if (!lcd_enabled) { 
         // std::cout << "LCD turned off\n";
         
         // Effectively reset the LCD 
-        dots = 0;
-        io.set_LY(0);
-        io.set_STAT((io.get_STAT() & ~0b11) | 0b00);
+        state.dots = 0;
+        state.LY = 0;
+        state.STAT = (state.STAT & ~0b11) | 0b00;
         return;
     }
 
-    dots++;
+    state.dots++;
 
     // Change PPU mode depending on dots
-    ppu_mode prev_mode = (ppu_mode)(io.get_STAT() & 0b11);
+    ppu_mode prev_mode = (ppu_mode)(state.STAT & 0b11);
     switch (prev_mode) {
         case Mode_OAM_Scan:
 
             // Change to Drawing (mode 3)
-            if (dots > oam_duration) {
+            if (state.dots > oam_duration) {
                 // std::cout << "PPU: Changing from OAM to Drawing" << std::endl;
-                // std::cout << "Dots: " << std::dec << +dots << std::endl;
+                // std::cout << "Dots: " << std::dec << +state.dots << std::endl;
 
-                io.set_STAT((io.get_STAT() & ~0b11) | 0b11);
+                state.STAT = (state.STAT & ~0b11) | 0b11;
             }
 
             break;
         case Mode_Drawing:
 
             // Change to HBlank (mode 0)
-            if (dots > draw_duration) {
+            if (state.dots > draw_duration) {
                 // std::cout << "PPU: Changing from Drawing to HBlank" << std::endl;
-                // std::cout << "Dots: " << std::dec << +dots << std::endl;
+                // std::cout << "Dots: " << std::dec << +state.dots << std::endl;
 
-                io.set_STAT((io.get_STAT() & ~0b11) | 0b00); // Set mode
-                if (BIT(io.get_STAT(), 3)) {                 // Request interrupt
-                    io.set_IF(io.get_IF() | 0b10); 
+                state.STAT = (state.STAT & ~0b11) | 0b00; // Set mode
+                if (BIT(state.STAT, 3)) {                 // Request interrupt
+                    state.IF |= 0b10; 
                 }
 
-                render_scanline(); // at the start HBlank
+                if (render_enabled) { // at the start HBlank
+                    render_scanline();
+                    GB_COUNT(scanlines_rendered);
+                } else {
+                    GB_COUNT(scanlines_skipped);
+                }
             }
             break;
         case Mode_HBlank:
             
             // Go to next scanline and change mode once HBlank is done
-            if (dots > dots_per_line) {
+            if (state.dots > dots_per_line) {
 
                 // Update scanline and handle any interrupts and flags
-                io.set_LY(io.get_LY() + 1); 
-                if (io.get_LYC() == io.get_LY()) {
-                    io.set_STAT(io.get_STAT() | 0b100); // Set coincidence flag
-                    if (BIT(io.get_STAT(), 6)) {        // Request interrupt
-                        io.set_IF(io.get_IF() | 0b10 );
+                state.LY++; 
+                if (state.LYC == state.LY) {
+                    state.STAT |= 0b100; // Set coincidence flag
+                    if (BIT(state.STAT, 6)) {        // Request interrupt
+                        state.IF |= 0b10;
                     }
                 }
 
                 // Change modes to VBlank or OAM Scan
-                if (io.get_LY() >= lcd_height) {
+                if (state.LY >= lcd_height) {
                     // Scanline out of viewport: Change to VBlank (mode 1)
                     // std::cout << "PPU: Changing from HBlank to VBlank" << std::endl;  
                         
-                    io.set_STAT((io.get_STAT() & ~0b11) | 0b01); // Set mode
-                    io.set_IF(io.get_IF() | 0b1);                // Request interrupts
-                    if (BIT(io.get_STAT(), 4)) {
-                        io.set_IF(io.get_IF() | 0b10);
+                    state.STAT = (state.STAT & ~0b11) | 0b01; // Set mode
+                    state.IF |= 0b1;                // Request interrupts
+                    if (BIT(state.STAT, 4)) {
+                        state.IF |= 0b10;
                     }
 
                     render_frame(); // at the start of VBlank
@@ -100,49 +121,49 @@ void PPU::step() {
                     // Scanline in viewport: Change to OAM Scan (mode 2)
                     // std::cout << "PPU: Changing from HBlank to OAM scan" << std::endl;
     
-                    io.set_STAT((io.get_STAT() & ~0b11) | 0b10); // Set mode
-                    if (BIT(io.get_STAT(), 5)) {                 // Request interrupt
-                        io.set_IF(io.get_IF() | 0b10);
+                    state.STAT = (state.STAT & ~0b11) | 0b10; // Set mode
+                    if (BIT(state.STAT, 5)) {                 // Request interrupt
+                        state.IF |= 0b10;
                     }
                 }
 
-                // std::cout << "Dots: " << std::dec << +dots << std::endl;
-                // std::cout << "Scanline (LY): " << +io.get_LY() << std::endl;
+                // std::cout << "Dots: " << std::dec << +state.dots << std::endl;
+                // std::cout << "Scanline (LY): " << +state.LY << std::endl;
 
-                dots = 0;
+                state.dots = 0;
             }
             
             break;
         case Mode_VBlank:
 
             // Change mode to OAM Scan or stay in VBlank
-            if (dots > dots_per_line) {
+            if (state.dots > dots_per_line) {
 
                 // Update scanline and handle any interrupts and flags
-                io.set_LY(io.get_LY() + 1); 
-                if (io.get_LYC() == io.get_LY()) {
-                    io.set_STAT(io.get_STAT() | 0b100); // Set coincidence flag
-                    if (BIT(io.get_STAT(), 6)) {        // Request interrupt
-                        io.set_IF(io.get_IF() | 0b10 );
+                state.LY++; 
+                if (state.LYC == state.LY) {
+                    state.STAT |= 0b100; // Set coincidence flag
+                    if (BIT(state.STAT, 6)) {        // Request interrupt
+                        state.IF |= 0b10;
                     }
                 }
 
-                if (io.get_LY() >= lines_per_frame) {
+                if (state.LY >= lines_per_frame) {
                     // VBlank is done: Change to OAM scan
                     // std::cout << "PPU: Changing from VBlank to OAM scan" << std::endl;
                     
-                    io.set_STAT((io.get_STAT() & ~0b11) | 0b10); // Set mode
-                    if (BIT(io.get_STAT(), 5)) {                 // Request interrupt
-                        io.set_IF(io.get_IF() | 0b10);
+                    state.STAT = (state.STAT & ~0b11) | 0b10; // Set mode
+                    if (BIT(state.STAT, 5)) {                 // Request interrupt
+                        state.IF |= 0b10;
                     }
 
-                    // std::cout << "Dots: " << std::dec << +dots << std::endl;
-                    // std::cout << "Scanline (LY): " << +io.get_LY() << std::endl;
+                    // std::cout << "Dots: " << std::dec << +state.dots << std::endl;
+                    // std::cout << "Scanline (LY): " << +state.LY << std::endl;
 
-                    io.set_LY(0);
+                    state.LY = 0;
                 }
 
-                dots = 0;
+                state.dots = 0;
             }
             
             break;
@@ -150,38 +171,39 @@ void PPU::step() {
 }
 
 void PPU::render_scanline() {
+    TRACE_ZONE("render_scanline");
 
-    // std::cout << "Rendering scanline " << std::dec << +io.get_LY() << std::endl;
-    // std::cout << "LCDC: 0x" << std::hex << +io.get_LCDC() << std::endl;
+    // std::cout << "Rendering scanline " << std::dec << +state.LY << std::endl;
+    // std::cout << "LCDC: 0x" << std::hex << +state.LCDC << std::endl;
 
     // Rendering background
-    bgw_enabled = BIT(io.get_LCDC(), 0);
+    bgw_enabled = BIT(state.LCDC, 0);
     if (bgw_enabled) {
         colour_id bg_palette[4] = {BGW_ID_0, BGW_ID_1, BGW_ID_2, BGW_ID_3}; 
 
         // Figure out which addressing mode and which tile map to use 
-        bgw_addr_mode = BIT(io.get_LCDC(), 4);
+        bgw_addr_mode = BIT(state.LCDC, 4);
         u16 base_ptr = bgw_addr_mode ? 0x8000 : 0x9000;
 
-        bg_map_select = BIT(io.get_LCDC(), 3);
+        bg_map_select = BIT(state.LCDC, 3);
         u16 bg_map = bg_map_select ? 0x9C00 : 0x9800;
 
         // std::cout << "Using 0x" << +base_ptr << " addressing mode" << std::endl; 
         // std::cout << "Using tilemap at 0x" << +bg_map << std::endl; 
 
-        // std::cout << "Viewport pos.: x: "  << std::dec << +(io.get_SCX()/8)
-        //     << " y: " << +(io.get_SCY()/8) << std::endl; 
+        // std::cout << "Viewport pos.: x: "  << std::dec << +(state.SCX/8)
+        //     << " y: " << +(state.SCY/8) << std::endl; 
 
         // Iterate by pixels
         for (
-            int pxl_i = io.get_SCX(); 
-            pxl_i < (int)(lcd_width + io.get_SCX()); 
+            int pxl_i = state.SCX; 
+            pxl_i < (int)(lcd_width + state.SCX); 
             pxl_i++
         ) {
 
             // Fetching tile number
             u16 tile_x = (pxl_i / 8) % 32;
-            u16 tile_y = ((io.get_LY() + io.get_SCY()) % 256) / 8;
+            u16 tile_y = ((state.LY + state.SCY) % 256) / 8;
             u16 tile_offset = (32 * tile_y + tile_x) % 1024;
             u16 bg_tile_num_addr = bg_map + tile_offset;
             u8 bg_tile_num = vram[bg_tile_num_addr - 0x8000];
@@ -197,7 +219,7 @@ void PPU::render_scanline() {
                     bg_tile_addr = base_ptr + ((int16_t)signed_tile_num * 16); 
                     break;
             }
-            u16 byte_offset = 2 * ((io.get_LY() + io.get_SCY()) % 8);
+            u16 byte_offset = 2 * ((state.LY + state.SCY) % 8);
             u8 lo_byte = vram[bg_tile_addr + byte_offset - 0x8000];
             u8 hi_byte = vram[bg_tile_addr + byte_offset + 1 - 0x8000];
 
@@ -205,25 +227,25 @@ void PPU::render_scanline() {
             u8 pxl_id = 
                 (BIT(hi_byte, (7 - (pxl_i % 8))) << 1) 
                 | BIT(lo_byte, (7 - (pxl_i % 8)));
-            lcd_buf[io.get_LY()][pxl_i - io.get_SCX()] = bg_palette[pxl_id];
+            lcd_buf[state.LY][pxl_i - state.SCX] = bg_palette[pxl_id];
         }
 
         // Rendering window
-        win_enabled = BIT(io.get_LCDC(), 5);
-        if (win_enabled && (io.get_WY() <= io.get_LY())) {
+        win_enabled = BIT(state.LCDC, 5);
+        if (win_enabled && (state.WY <= state.LY)) {
 
             // Figure out which window tile map to use
-            win_map_select = BIT(io.get_LCDC(), 6);
+            win_map_select = BIT(state.LCDC, 6);
             u16 win_map = (win_map_select) ? 0x9C00 : 0x9800; 
 
             // Iterate by tile then by pixel
             for (
                 int tile_i = 0;
-                (tile_i + (io.get_WX() / 8)) < (int)((lcd_width + 7) / 8);
+                (tile_i + (state.WX / 8)) < (int)((lcd_width + 7) / 8);
                 tile_i++
             ) {
                 // Fetching tile number
-                u16 tile_y = ((io.get_LY() - io.get_WY()) % 256) / 8;
+                u16 tile_y = ((state.LY - state.WY) % 256) / 8;
                 u16 tile_offset = (32 * tile_y + tile_i) % 1024;
                 u16 win_tile_num_addr = win_map + tile_offset;
                 u8 win_tile_num = vram[win_tile_num_addr - 0x8000];
@@ -239,22 +261,22 @@ void PPU::render_scanline() {
                         win_tile_addr = base_ptr + ((int16_t)signed_tile_num * 16); 
                         break;
                 }
-                u16 byte_offset = 2 * ((io.get_LY() - io.get_WY()) % 8);
+                u16 byte_offset = 2 * ((state.LY - state.WY) % 8);
                 u8 lo_byte = vram[win_tile_addr + byte_offset - 0x8000];
                 u8 hi_byte = vram[win_tile_addr + byte_offset + 1 - 0x8000];
 
                 // Render pixels to LCD buffer
                 for (int pxl_i = 0; pxl_i < 8; pxl_i++) {   
-                    u8 pxl_x = ((io.get_WX() - 7) + 8 * tile_i + pxl_i) % lcd_width;
+                    u8 pxl_x = ((state.WX - 7) + 8 * tile_i + pxl_i) % lcd_width;
                     u8 pxl_id = (BIT(hi_byte, (7 - pxl_i)) << 1) | BIT(lo_byte, (7 - pxl_i));
-                    lcd_buf[io.get_LY()][pxl_x] = bg_palette[pxl_id];
+                    lcd_buf[state.LY][pxl_x] = bg_palette[pxl_id];
                 }
             }
         }
     }    
 
     // Rendering sprites
-    sprites_enabled = BIT(io.get_LCDC(), 1);
+    sprites_enabled = BIT(state.LCDC, 1);
     if (sprites_enabled) {
 
         // Fill up sprite buffer
@@ -284,7 +306,7 @@ void PPU::render_scanline() {
         for (int i = 0; i < lcd_width; i++) temp_scanline[i] = None_Transparent;
 
         // Sprite size is global
-        sprite_size = BIT(io.get_LCDC(), 2);
+        sprite_size = BIT(state.LCDC, 2);
         u8 sprite_height = sprite_size ? 16 : 8; 
 
         // Go through sprite buffer (which was filled by OAM Scan)
@@ -310,7 +332,7 @@ void PPU::render_scanline() {
             bool palette_select = BIT(attribs, 4);
 
             // std::cout << "Rendering sprite at addr: 0x" << std::hex << +(0xFE00+sprite_addr)
-            //     << " LY: " << std::dec << +io.get_LY()
+            //     << " LY: " << std::dec << +state.LY
             //     << " sprite x: " << +x_pos << " sprite y: " << +y_pos << " tile num: " << +tile_num
             //     << " y_flip: " << +y_flip << " x_flip: " << +x_flip
             //     << " behind_bgw: " << +behind_bgw << std::endl;
@@ -319,8 +341,8 @@ void PPU::render_scanline() {
             u16 sprite_tile_addr = (u16)tile_num * 16;
             if (sprite_height == 16) {
                 bool grab_top_tile = 
-                    (!y_flip && io.get_LY() + 16 < y_pos + 8)
-                    || (y_flip && io.get_LY() + 16 >= y_pos + 8);
+                    (!y_flip && state.LY + 16 < y_pos + 8)
+                    || (y_flip && state.LY + 16 >= y_pos + 8);
 
                 sprite_tile_addr = (grab_top_tile) 
                     ? ((u16)(tile_num & 0xFE)) * 16
@@ -330,10 +352,10 @@ void PPU::render_scanline() {
             // std::cout << "Sprite tile addr (in VRAM): 0x" << std::hex << +(0x8000+sprite_tile_addr) << std::endl;
 
             u16 byte_offset = (y_flip) 
-                ? 2 * ((y_pos + 7 * (io.get_LY() + 16 + 1)) % 8)
-                : 2 * ((io.get_LY() + 16 - y_pos) % 8);
+                ? 2 * ((y_pos + 7 * (state.LY + 16 + 1)) % 8)
+                : 2 * ((state.LY + 16 - y_pos) % 8);
 
-            // u16 byte_offset = 2 * ((io.get_LY() + 16 - y_pos) % 8);
+            // u16 byte_offset = 2 * ((state.LY + 16 - y_pos) % 8);
 
             // std::cout << "Byte offset in sprite tile: 0x" << std::hex << +(byte_offset) << std::endl;
 
@@ -366,7 +388,7 @@ void PPU::render_scanline() {
 
                 if (behind_bgw) {
                     // Mask sprite by BG/W colours 1-3
-                    colour_id bgw_cid = lcd_buf[io.get_LY()][x_pos - 8 + pxl_i];
+                    colour_id bgw_cid = (colour_id)lcd_buf[state.LY][x_pos - 8 + pxl_i];
                     if (bgw_cid != BGW_ID_0)
                         temp_scanline[x_pos - 8 + pxl_i] = None_Transparent;
                 }     
@@ -376,7 +398,7 @@ void PPU::render_scanline() {
         // Render temporary buffer to LCD buffer
         for (int pxl_i = 0; pxl_i < lcd_width; pxl_i++) {
             if (temp_scanline[pxl_i] != None_Transparent)
-                lcd_buf[io.get_LY()][pxl_i] = temp_scanline[pxl_i];
+                lcd_buf[state.LY][pxl_i] = temp_scanline[pxl_i];
         }
 
     }
@@ -387,11 +409,14 @@ void PPU::render_frame() {
 
     // std::cout << "Rendering frame" << std::endl;
 
+    frame_count++;
+
+    // Frames emulated only for their side effects are never shown, and
+    // without a window whoever drives us picks frames up with get_frame()
+    if (!render_enabled || headless) return;
+
     // Timing 
     u32 end_ms = SDL_GetTicks();
-    u32 time_taken_ms = end_ms - start_ms; 
-
-    // std::cout << "Frame time taken (ms): " << std::dec << +time_taken_ms << std::endl;
 
     // Show FPS every second
     frames++;
@@ -401,87 +426,101 @@ void PPU::render_frame() {
         timer_start_ms = SDL_GetTicks();
     }
 
-    // Each frame should take a fixed number of seconds
-    if (time_taken_ms < frame_ms) {
-        u32 delay_ms = frame_ms - time_taken_ms;
-        // std::cout << "Delaying for " << std::dec << +delay_ms << " ms" << std::endl; 
-        SDL_Delay(delay_ms);
+    // Present on a fixed schedule of absolute deadlines, so rounding in
+    // each sleep doesn't add up to drift. Audio rate control absorbs
+    // whatever jitter is left.
+    {
+        TRACE_ZONE("frame pacing");
+        u64 freq = SDL_GetPerformanceFrequency();
+        u64 period = (u64)(freq / frame_rate);
+        u64 now = SDL_GetPerformanceCounter();
+        if (next_frame_time == 0 || now > next_frame_time + 4 * period) {
+            // First frame or far behind (e.g. the window was dragged): resync
+            next_frame_time = now;
+        }
+        while (now < next_frame_time) {
+            u32 wait_ms = (u32)((next_frame_time - now) * 1000 / freq);
+            if (wait_ms > 1) SDL_Delay(wait_ms - 1);
+            now = SDL_GetPerformanceCounter();
+        }
+        next_frame_time += period;
     }
 
-    start_ms = SDL_GetTicks();
-
     // Rendering pixels from buffer to SDL window
-    for (int y = 0; y < lcd_height; y++) {
-        for (int x = 0; x < lcd_width; x++) {
-
-            SDL_Rect pxl; 
-            pxl.x = x * lcd_scale;
-            pxl.y = y * lcd_scale;
-            pxl.w = lcd_scale;
-            pxl.h = lcd_scale;
-
-            u8 colour;
-            switch (lcd_buf[y][x]) {
-                case BGW_ID_0: 
-                case None_Transparent:
-                    colour = io.get_BGP() & 0b11;
-                    break;
-                case BGW_ID_1: 
-                    colour = (io.get_BGP() >> 2) & 0b11;
-                    break;
-                case BGW_ID_2: 
-                    colour = (io.get_BGP() >> 4) & 0b11;
-                    break;
-                case BGW_ID_3: 
-                    colour = (io.get_BGP() >> 6) & 0b11;
-                    break;
-                case OBP0_ID_1: 
-                    colour = (io.get_OBP0() >> 2) & 0b11;
-                    break;
-                case OBP0_ID_2: 
-                    colour = (io.get_OBP0() >> 4) & 0b11;
-                    break;
-                case OBP0_ID_3: 
-                    colour = (io.get_OBP0() >> 6) & 0b11;
-                    break;
-                case OBP1_ID_1: 
-                    colour = (io.get_OBP1() >> 2) & 0b11;
-                    break;
-                case OBP1_ID_2: 
-                    colour = (io.get_OBP1() >> 4) & 0b11;
-                    break;
-                case OBP1_ID_3: 
-                    colour = (io.get_OBP1() >> 6) & 0b11;
-                    break;
-                
-            }
-            switch (colour) {
-                case 0: // "White"
-                    SDL_SetRenderDrawColor(renderer, 154, 158, 63, 255); 
-                    break;
-                case 1: // "Light gray"
-                    SDL_SetRenderDrawColor(renderer, 73, 107, 34, 255); 
-                    break;
-                case 2: // "Dark gray"
-                    SDL_SetRenderDrawColor(renderer, 14, 69, 11, 255); 
-                    break;
-                case 3: // "Black"
-                    SDL_SetRenderDrawColor(renderer, 27, 42, 9, 255); 
-                    break;
-
+    {
+        TRACE_ZONE("render_frame convert");
+        for (int y = 0; y < lcd_height; y++) {
+            for (int x = 0; x < lcd_width; x++) {
+
+                SDL_Rect pxl; 
+                pxl.x = x * lcd_scale;
+                pxl.y = y * lcd_scale;
+                pxl.w = lcd_scale;
+                pxl.h = lcd_scale;
+
+                const u8 *rgb = palette[shade(lcd_buf[y][x])];
+                SDL_SetRenderDrawColor(renderer, rgb[0], rgb[1], rgb[2], 255);
+                SDL_RenderFillRect(renderer, &pxl); 
             }
-            SDL_RenderFillRect(renderer, &pxl); 
         }
     }
 
-    SDL_RenderPresent(renderer);
+    {
+        TRACE_ZONE("SDL present");
+        SDL_RenderPresent(renderer);
+    }
 
     // Handling shutdown requests every frame speeds up emulator
     event_handler.handle_events();   
 }
 
+u64 PPU::get_frame_count() {
+    return frame_count;
+}
+
+void PPU::set_render_enabled(bool enabled) {
+    render_enabled = enabled;
+}
+
+u8 PPU::shade(u8 id) {
+    // Look colour IDs up in the palette they were drawn with
+    switch (id) {
+        case BGW_ID_1: return (state.BGP >> 2) & 0b11;
+        case BGW_ID_2: return (state.BGP >> 4) & 0b11;
+        case BGW_ID_3: return (state.BGP >> 6) & 0b11;
+        case OBP0_ID_1: return (state.OBP0 >> 2) & 0b11;
+        case OBP0_ID_2: return (state.OBP0 >> 4) & 0b11;
+        case OBP0_ID_3: return (state.OBP0 >> 6) & 0b11;
+        case OBP1_ID_1: return (state.OBP1 >> 2) & 0b11;
+        case OBP1_ID_2: return (state.OBP1 >> 4) & 0b11;
+        case OBP1_ID_3: return (state.OBP1 >> 6) & 0b11;
+        default: return state.BGP & 0b11; // BGW_ID_0 and None_Transparent
+    }
+}
+
+const u8 *PPU::get_lcd_buf() {
+    return &lcd_buf[0][0];
+}
+
+void PPU::set_lcd_buf(const u8 *buf) {
+    memcpy(lcd_buf, buf, sizeof(lcd_buf));
+}
+
+void PPU::get_shade_map(u8 *map) {
+    for (int id = BGW_ID_0; id <= None_Transparent; id++) map[id] = shade(id);
+}
+
+void PPU::get_frame(u8 *out) {
+    // One shade (0-3) per pixel, row by row
+    for (int y = 0; y < lcd_height; y++) {
+        for (int x = 0; x < lcd_width; x++) {
+            out[y * lcd_width + x] = shade(lcd_buf[y][x]);
+        }
+    }
+}
+
 u8 PPU::vram_read(u16 addr) {
-    // ppu_mode curr_mode = (ppu_mode)(io.get_STAT() & 0b11);
+    // ppu_mode curr_mode = (ppu_mode)(state.STAT & 0b11);
     // if (curr_mode == Mode_Drawing) {
     //     // std::cout << "PPU: Locked out of reading VRAM -> returning garbage\n";
     //     return 0xFF;
@@ -493,7 +532,7 @@ u8 PPU::vram_read(u16 addr) {
 }
 
 void PPU::vram_write(u16 addr, u8 val) {
-    // ppu_mode curr_mode = (ppu_mode)(io.get_STAT() & 0b11);
+    // ppu_mode curr_mode = (ppu_mode)(state.STAT & 0b11);
     // if (curr_mode == Mode_Drawing) {
     //     // std::cout << "PPU: Locked out of writing VRAM\n";
     //     return; 
@@ -519,7 +558,7 @@ void PPU::print_vram() {
 
 u8 PPU::oam_read(u16 addr) {
     // std::cout << "Reading OAM" << std::endl;
-    // ppu_mode curr_mode = (ppu_mode)(io.get_STAT() & 0b11);
+    // ppu_mode curr_mode = (ppu_mode)(state.STAT & 0b11);
     // if (curr_mode == Mode_Drawing || curr_mode == Mode_OAM_Scan) {
     //     // std::cout << "PPU: Locked out of reading OAM -> returning garbage\n";
     //     return 0xFF;
@@ -532,7 +571,7 @@ u8 PPU::oam_read(u16 addr) {
 
 void PPU::oam_write(u16 addr, u8 val) {
     // std::cout << "Writing to OAM" << std::endl;
-    // ppu_mode curr_mode = (ppu_mode)(io.get_STAT() & 0b11);
+    // ppu_mode curr_mode = (ppu_mode)(state.STAT & 0b11);
     // if (curr_mode == Mode_Drawing || curr_mode == Mode_OAM_Scan) {
     //     // std::cout << "PPU: Locked out of writing OAM\n";
     //     return; 
@@ -551,7 +590,7 @@ void PPU::oam_scan() {
         return;
     }
 
-    sprite_size = BIT(io.get_LCDC(), 2);
+    sprite_size = BIT(state.LCDC, 2);
     u8 height = sprite_size ? 16 : 8;
 
     // There are 40 sprites in OAM
@@ -565,10 +604,10 @@ void PPU::oam_scan() {
         // std::cout << "Scanning sprite at addr: 0x" << std::hex << +(0xFE00+sprite_addr) << std::endl;
         
         // Push sprites that are hit by the current scanline
-        bool add_sprite = ((io.get_LY() + 16) >= y_pos) && ((io.get_LY() + 16) < (y_pos + height));
+        bool add_sprite = ((state.LY + 16) >= y_pos) && ((state.LY + 16) < (y_pos + height));
         if (add_sprite) {
             // std::cout << "OAM Scan: Adding sprite at addr: 0x" << std::hex << +(0xFE00+sprite_addr)
-            //     << " LY: " << std::dec << +io.get_LY()
+            //     << " LY: " << std::dec << +state.LY
             //     << " sprite x: " << +x_pos << " sprite y: " << +y_pos << " sprite height: " << +height << std::endl;
             
             sprite_buffer.push_back(sprite_addr);
@@ -591,4 +630,30 @@ void PPU::print_oam() {
             std::cout << "0x" << std::hex << +start << ": ";
         }
     }
+}
+
+void PPU::serialize(SaveState &save) {
+    memcpy(save.ppu.vram, vram, sizeof(vram));
+    memcpy(save.ppu.oam, oam, sizeof(oam));
+    memcpy(save.ppu.lcd_buf, lcd_buf, sizeof(lcd_buf));
+
+    // Scanline rendering drains the sprite buffer, but store it anyway
+    save.ppu.sprite_count = sprite_buffer.size();
+    for (u8 i = 0; i < save.ppu.sprite_count; i++) {
+        save.ppu.sprite_buffer[i] = sprite_buffer[i];
+    }
+    for (u8 i = save.ppu.sprite_count; i < sprite_limit; i++) {
+        save.ppu.sprite_buffer[i] = 0;
+    }
+}
+
+void PPU::deserialize(const SaveState &save) {
+    memcpy(vram, save.ppu.vram, sizeof(vram));
+    memcpy(oam, save.ppu.oam, sizeof(oam));
+    memcpy(lcd_buf, save.ppu.lcd_buf, sizeof(lcd_buf));
+
+    sprite_buffer.clear();
+    for (u8 i = 0; i < save.ppu.sprite_count && i < sprite_limit; i++) {
+        sprite_buffer.push_back(save.ppu.sprite_buffer[i]);
+    }
 }
\ No newline at end of file
@@ -2,8 +2,11 @@
 #define PPU_H
 
 #include "common.h"
-#include "io.h"
+#include "machine_state.h"
+#include "save_state.h"
 #include "event_handler.h"
+#include "counters.h"
+#include "trace.h"
 #include "SDL.h"
 
 typedef enum {
@@ -33,15 +36,17 @@ class PPU {
         SDL_Renderer *renderer = nullptr;
         
         u32 frames = 0;
-        const u32 frame_ms = 1000 / 60;
-        u32 start_ms = 0;
+        u64 frame_count = 0; // Frames completed since power on
+        bool render_enabled = true; // Off skips drawing and presenting
+        bool headless;              // No window, no pacing, no events
+        const double frame_rate = 4194304.0 / 70224; // ~59.73 Hz
+        u64 next_frame_time = 0; // Performance counter value to present at
         u32 timer_start_ms = 0;
 
         const u8 lcd_width = 160;
         const u8 lcd_height = 144;
         const u8 lcd_scale = 4;
-        colour_id lcd_buf[144][160];
-        int dots = 0;
+        u8 lcd_buf[144][160]; // Holds colour_id values
         const u16 dots_per_line = 456;
         const u8 lines_per_frame = 154;
 
@@ -65,14 +70,24 @@ class PPU {
         std::deque<u8> sprite_buffer; // Deque of sprites populated by OAM scan
         const u8 sprite_limit = 10;
         
-        IO &io;
+        MachineState &state;
         EventHandler &event_handler;
     public:
-        PPU(IO &io_, EventHandler &event_handler_);
+        static const u8 palette[4][3]; // RGB for each shade, lightest first
+
+        PPU(MachineState &state_, EventHandler &event_handler_, bool headless_ = false);
         ~PPU();
+        void reset();  // Clears video memory; the window stays open
         void step();   
         void render_scanline();
         void render_frame();
+        u64 get_frame_count();
+        void set_render_enabled(bool enabled);
+        u8 shade(u8 id);
+        void get_frame(u8 *out);
+        const u8 *get_lcd_buf();        // 160x144 colour_id values, row by row
+        void set_lcd_buf(const u8 *buf);
+        void get_shade_map(u8 *map);    // Shade for each colour_id (None_Transparent + 1 entries)
         u8 vram_read(u16 addr);
         void vram_write(u16 addr, u8 val);  
         void print_vram();
@@ -80,6 +95,8 @@ class PPU {
         void oam_write(u16 addr, u8 val);
         void oam_scan();
         void print_oam();
+        void serialize(SaveState &save);
+        void deserialize(const SaveState &save);
 
 };
 
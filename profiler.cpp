@@ -0,0 +1,166 @@
+#include "profiler.h"
+#include <sstream>
+
+const size_t max_depth = 256; // Deeper than any real game; recursion gone wrong stops here
+
+Profiler::Profiler() {
+    clear();
+}
+
+Profiler::~Profiler() {}
+
+void Profiler::clear() {
+    nodes.assign(1, {-1, 0, 0});
+    children.clear();
+    stack.clear();
+    current = 0;
+    by_bank.clear();
+    total = 0;
+    halted_total = 0;
+}
+
+void Profiler::restart_stack() {
+    stack.clear();
+    current = 0;
+}
+
+int Profiler::child(int parent, u32 func) {
+    u64 key = ((u64)parent << 32) | func;
+    auto it = children.find(key);
+    if (it != children.end()) return it->second;
+
+    nodes.push_back({parent, func, 0});
+    children[key] = nodes.size() - 1;
+    return nodes.size() - 1;
+}
+
+void Profiler::enter(u32 func, u16 sp) {
+    if (stack.size() >= max_depth) return;
+    current = child(current, func);
+    stack.push_back({current, sp});
+}
+
+void Profiler::instruction(u32 where, u8 opcode, u32 cycles, u16 sp_before, u16 sp_after, u32 target) {
+    u32 bank = where >> 16;
+    if (bank >= by_bank.size()) by_bank.resize(bank + 1);
+    if (!by_bank[bank]) {
+        by_bank[bank].reset(new u64[0x10000]);
+        memset(by_bank[bank].get(), 0, 0x10000 * sizeof(u64));
+    }
+    by_bank[bank][where & 0xFFFF] += cycles;
+    nodes[current].cycles += cycles;
+    total += cycles;
+
+    switch (opcode) {
+        case 0xCD: case 0xC4: case 0xCC: case 0xD4: case 0xDC: // CALL, taken when it pushed
+            if (sp_after == (u16)(sp_before - 2)) enter(target, sp_after);
+            break;
+        case 0xC7: case 0xCF: case 0xD7: case 0xDF: case 0xE7: case 0xEF: case 0xF7: case 0xFF: // RST
+            enter(target, sp_after);
+            break;
+        case 0xC9: case 0xD9: case 0xC0: case 0xC8: case 0xD0: case 0xD8: // RET, RETI, taken when it popped
+            if (sp_after != (u16)(sp_before + 2)) break;
+            while (!stack.empty() && stack.back().sp < sp_after) stack.pop_back();
+            current = stack.empty() ? 0 : stack.back().node;
+            break;
+    }
+}
+
+void Profiler::interrupt(u32 vector, u16 sp) {
+    enter(vector, sp);
+}
+
+void Profiler::halted(u32 cycles) {
+    nodes[child(current, Halted)].cycles += cycles;
+    total += cycles;
+    halted_total += cycles;
+}
+
+bool Profiler::load_symbols(const char *path) {
+    std::ifstream ifs;
+    ifs.open(path);
+    if (ifs.fail()) {
+        std::cout << "Symbol file failed to open\n";
+        return false;
+    }
+
+    // RGBDS: "BB:AAAA Label", ; starts a comment
+    std::string line;
+    while (std::getline(ifs, line)) {
+        line = line.substr(0, line.find(';'));
+        unsigned bank, addr;
+        char label[256];
+        if (sscanf(line.c_str(), " %x:%x %255s", &bank, &addr, label) == 3) {
+            // Only ROMX is banked as far as where is concerned
+            if (addr < 0x4000 || addr >= 0x8000) bank = 0;
+            symbols[(bank << 16) | (addr & 0xFFFF)] = label;
+        }
+    }
+    return true;
+}
+
+std::string Profiler::name(u32 key, bool with_offset) {
+    if (key == Halted) return "(halted)";
+
+    // Nearest label at or before key, in the same bank
+    auto it = symbols.upper_bound(key);
+    if (it != symbols.begin()) {
+        --it;
+        if ((it->first >> 16) == (key >> 16)) {
+            if (!with_offset || it->first == key) return it->second;
+            std::ostringstream out;
+            out << it->second << "+" << std::hex << key - it->first;
+            return out.str();
+        }
+    }
+
+    std::ostringstream out;
+    out << std::hex << std::setfill('0') << std::setw(2) << (key >> 16) << ":" << std::setw(4) << (key & 0xFFFF);
+    return out.str();
+}
+
+std::string Profiler::stack_name(int node) {
+    std::vector<int> path;
+    for (int n = node; n > 0; n = nodes[n].parent) path.push_back(n);
+
+    std::string out = "(root)";
+    for (auto it = path.rbegin(); it != path.rend(); ++it) out += ";" + name(nodes[*it].func, false);
+    return out;
+}
+
+void Profiler::print_report(std::ostream &out, int top) {
+    struct Hot { u32 key; u64 cycles; };
+    std::vector<Hot> hot;
+    for (u32 bank = 0; bank < by_bank.size(); bank++) {
+        if (!by_bank[bank]) continue;
+        for (u32 addr = 0; addr < 0x10000; addr++) {
+            if (by_bank[bank][addr]) hot.push_back({(bank << 16) | addr, by_bank[bank][addr]});
+        }
+    }
+    std::sort(hot.begin(), hot.end(), [](const Hot &a, const Hot &b) { return a.cycles > b.cycles; });
+    if (hot.size() > (size_t)top) hot.resize(top);
+
+    out << std::dec << std::fixed << std::setprecision(1) << std::setfill(' ')
+        << "Profiled " << total << " cycles, " << (total ? 100.0 * halted_total / total : 0.0) << "% halted\n";
+    for (const Hot &h : hot) {
+        out << "  " << std::hex << std::setfill('0') << std::setw(2) << (h.key >> 16) << ":" << std::setw(4) << (h.key & 0xFFFF)
+            << std::dec << std::setfill(' ') << std::setw(14) << h.cycles << std::setw(7) << 100.0 * h.cycles / total
+            << "%  " << name(h.key, true) << "\n";
+    }
+}
+
+bool Profiler::write_folded(const char *path) {
+    std::ofstream ofs;
+    ofs.open(path);
+    if (ofs.fail()) {
+        std::cout << "Profile file failed to be created\n";
+        return false;
+    }
+
+    // One line per stack: frames from the root down, then its own cycles
+    for (size_t n = 0; n < nodes.size(); n++) {
+        if (nodes[n].cycles) ofs << stack_name(n) << " " << nodes[n].cycles << "\n";
+    }
+    ofs.close();
+    return !ofs.fail();
+}
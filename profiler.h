@@ -0,0 +1,66 @@
+#ifndef PROFILER_H
+#define PROFILER_H
+
+#include "common.h"
+#include <vector>
+#include <map>
+#include <unordered_map>
+#include <memory>
+
+// Where the guest program spends its cycles.
+//
+// Every instruction adds its T-cycles to its address, as bank:PC, and to
+// the call stack it ran under. That stack is a shadow of the real one:
+// CALL, RST and interrupt entry push a frame, RET and RETI pop every
+// frame the new SP is above, so code that pops return addresses or jumps
+// out through the stack doesn't leave it out of step for long. Stacks are
+// nodes of a call tree, so each instruction is one addition there too.
+//
+// Names come from RGBDS .sym files when given; the results are a report
+// of the hottest addresses and folded stacks for flamegraph tools.
+class Profiler {
+    private:
+        struct Node {
+            int parent;
+            u32 func;   // bank << 16 | address it was called at
+            u64 cycles; // Spent in the function itself, not its callees
+        };
+        struct Frame {
+            int node;
+            u16 sp;     // SP right after the return address was pushed
+        };
+
+        std::vector<Node> nodes;                 // 0 is the root
+        std::unordered_map<u64, int> children;   // parent << 32 | func -> node
+        std::vector<Frame> stack;
+        int current = 0;
+
+        std::vector<std::unique_ptr<u64[]>> by_bank; // Cycles per address, 64 KB per bank
+        u64 total = 0;
+        u64 halted_total = 0;
+        std::map<u32, std::string> symbols;      // bank << 16 | address -> label
+
+        int child(int parent, u32 func);
+        void enter(u32 func, u16 sp);
+        std::string name(u32 key, bool with_offset);
+        std::string stack_name(int node);
+    public:
+        static const u32 Halted = 0xFFFFFFFF; // Pseudo-function for HALT
+
+        Profiler();
+        ~Profiler();
+
+        // Hooks for the CPU. where and target are bank << 16 | address.
+        void instruction(u32 where, u8 opcode, u32 cycles, u16 sp_before, u16 sp_after, u32 target);
+        void interrupt(u32 vector, u16 sp);
+        void halted(u32 cycles);
+        void restart_stack(); // After loading a state the old stack means nothing
+
+        bool load_symbols(const char *path);
+        void clear();
+
+        void print_report(std::ostream &out, int top = 20);
+        bool write_folded(const char *path);
+};
+
+#endif
@@ -0,0 +1,189 @@
+#include "movie.h"
+#include "rom.h"
+#include "thread_pool.h"
+#include <memory>
+#include <chrono>
+#include <mutex>
+#include <condition_variable>
+
+// gb-replay: verifies a movie on every core.
+//
+// Keyframes split the movie into segments that start from a full state,
+// so each one replays on its own worker. A segment passes when it ends
+// in exactly the state of the next keyframe (or the recorded end state).
+// Per-frame hashes of the picture come out in frame order regardless:
+// finished segments wait in a reorder buffer until everything before
+// them has been written.
+//
+//     gb-replay [-j threads] [-o hashes.txt] [-k interval] rom movie
+//
+// -k rewrites the movie with a keyframe every interval frames, replaying
+// it once serially, so movies recorded without them can be split too.
+
+struct Segment {
+    u64 first = 0;                // Frame the segment starts at
+    u64 count = 0;
+    const SaveState *start = nullptr;
+    u32 end_crc = 0;              // What the last frame has to lead to
+    bool check_end = false;
+
+    // Filled in by whichever worker runs it
+    std::vector<u64> hashes;
+    bool ok = false;
+    bool done = false;
+};
+
+// Segments finished so far, handed to the writer in order
+struct ReorderBuffer {
+    std::mutex lock;
+    std::condition_variable ready;
+};
+
+void run_segment(Segment &seg, Movie &movie, Emulator &emu, bool hash, ReorderBuffer &reorder) {
+    bool ok = emu.load_state(*seg.start);
+    if (hash) seg.hashes.reserve(seg.count);
+    for (u64 i = 0; ok && i < seg.count; i++) {
+        emu.set_joypad(movie.input(seg.first + i));
+        ok = emu.run_frame();
+        if (hash) seg.hashes.push_back(emu.frame_hash());
+    }
+    if (ok && seg.check_end) ok = state_crc(emu) == seg.end_crc;
+
+    std::lock_guard<std::mutex> guard(reorder.lock);
+    seg.ok = ok;
+    seg.done = true;
+    reorder.ready.notify_all();
+}
+
+// Serial pass that records the same movie again, with keyframes
+bool add_keyframes(Movie &movie, const char *rom, const char *path, u64 interval) {
+    Emulator emu;
+    if (!emu.load_rom(rom) || !movie.rewind(emu)) return false;
+
+    Movie out;
+    out.set_keyframe_interval(interval);
+    out.begin(emu);
+    for (u64 i = 0; i < movie.frames(); i++) {
+        out.record(emu, movie.input(i));
+        emu.set_joypad(movie.input(i));
+        if (!emu.run_frame()) return false;
+    }
+    out.finish(emu);
+
+    if (movie.has_end() && !movie.matches_end(emu)) {
+        std::cout << "Movie desyncs, so keyframes were not added\n";
+        return false;
+    }
+    return out.save_file(path);
+}
+
+int main(int argc, char** argv) {
+    int threads = 0;
+    const char *hash_path = nullptr;
+    u64 interval = 0;
+    int opt;
+    while ((opt = getopt(argc, argv, "j:o:k:")) != -1) {
+        switch (opt) {
+            case 'j': threads = atoi(optarg); break;
+            case 'o': hash_path = optarg; break;
+            case 'k': interval = strtoull(optarg, nullptr, 10); break;
+        }
+    }
+    if (optind + 2 > argc) {
+        std::cout << "usage: gb-replay [-j threads] [-o hashes.txt] [-k interval] rom movie\n";
+        return -1;
+    }
+    const char *rom = argv[optind];
+    const char *movie_path = argv[optind + 1];
+
+    Movie movie;
+    if (!movie.load_file(movie_path)) return -1;
+
+    if (interval > 0) {
+        if (!add_keyframes(movie, rom, movie_path, interval)) return -2;
+        std::cout << "Added keyframes every " << interval << " frames to " << movie_path << std::endl;
+        return 0;
+    }
+
+    // One segment from the start and one from every keyframe
+    const std::vector<Keyframe> &keys = movie.get_keyframes();
+    std::vector<Segment> segments(keys.size() + 1);
+    for (size_t k = 0; k < segments.size(); k++) {
+        Segment &seg = segments[k];
+        seg.first = k == 0 ? 0 : keys[k - 1].frame;
+        seg.start = k == 0 ? &movie.get_start() : keys[k - 1].state.get();
+        if (k < keys.size()) {
+            seg.count = keys[k].frame - seg.first;
+            seg.end_crc = state_crc(*keys[k].state);
+            seg.check_end = true;
+        } else {
+            seg.count = movie.frames() - seg.first;
+            seg.end_crc = movie.get_end_crc();
+            seg.check_end = movie.has_end();
+        }
+    }
+
+    std::ofstream hashes;
+    if (hash_path) {
+        hashes.open(hash_path);
+        if (hashes.fail()) {
+            std::cout << "Hash file failed to be created\n";
+            return -1;
+        }
+    }
+
+    auto start = std::chrono::steady_clock::now();
+    ReorderBuffer reorder;
+    int failed = 0;
+    {
+        ThreadPool pool(threads);
+        threads = pool.size();
+
+        // Every worker keeps one instance; the ROM is mapped once for all
+        std::vector<std::unique_ptr<Emulator>> emus(threads);
+        for (auto &emu : emus) {
+            emu.reset(new Emulator());
+            if (!emu->load_rom(rom)) return -1;
+        }
+
+        // Segments start from states, which don't say which ROM they need
+        if (!movie.matches_rom(*emus[0])) return -1;
+
+        // Workers take their newest task first, so submitting back to
+        // front has them work through the movie front to back
+        for (size_t k = segments.size(); k-- > 0;) {
+            Segment &seg = segments[k];
+            pool.submit([&seg, &movie, &emus, &reorder, hash_path](int w) {
+                run_segment(seg, movie, *emus[w], hash_path != nullptr, reorder);
+            });
+        }
+
+        // Write out each segment as soon as everything before it is done
+        for (Segment &seg : segments) {
+            std::unique_lock<std::mutex> guard(reorder.lock);
+            reorder.ready.wait(guard, [&seg] { return seg.done; });
+            guard.unlock();
+
+            if (!seg.ok) {
+                failed++;
+                std::cout << "Desync in frames " << seg.first << "-" << seg.first + seg.count - 1 << std::endl;
+            }
+            for (u64 i = 0; i < seg.hashes.size(); i++) {
+                hashes << std::dec << seg.first + i << " " << std::hex << std::setw(16)
+                       << std::setfill('0') << seg.hashes[i] << "\n";
+            }
+            std::vector<u64>().swap(seg.hashes);
+        }
+        pool.wait();
+    }
+    std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+
+    if (hash_path) hashes.close();
+
+    double fps = movie.frames() / elapsed.count();
+    std::cout << std::dec << std::fixed << std::setprecision(1)
+        << movie.frames() << " frames in " << segments.size() << " segments, " << failed << " desynced, "
+        << elapsed.count() << " s on " << threads << " threads: " << fps << " frames/s\n";
+
+    return failed ? -3 : 0;
+}
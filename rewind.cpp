@@ -0,0 +1,157 @@
+#include "rewind.h"
+
+// Deltas are a sequence of (unchanged run, changed run, changed bytes)
+// with both run lengths stored as LEB128 varints
+static u32 put_varint(u8 *out, u32 val) {
+    u32 n = 0;
+    while (val >= 0x80) {
+        out[n++] = (val & 0x7F) | 0x80;
+        val >>= 7;
+    }
+    out[n++] = val;
+    return n;
+}
+
+static u32 get_varint(const u8 *in, u32 &pos) {
+    u32 val = 0;
+    for (int shift = 0; ; shift += 7) {
+        u8 byte = in[pos++];
+        val |= (u32)(byte & 0x7F) << shift;
+        if (!(byte & 0x80)) break;
+    }
+    return val;
+}
+
+RewindBuffer::RewindBuffer(u32 capacity_bytes) : capacity(capacity_bytes) {
+    ring = new u8[capacity];
+    scratch = new u8[2 * sizeof(SaveState) + 16];
+}
+
+RewindBuffer::~RewindBuffer() {
+    delete[] ring;
+    delete[] scratch;
+}
+
+u32 RewindBuffer::encode(const u8 *prev, const u8 *next, u8 *out) {
+    const u32 n = sizeof(SaveState);
+    u32 i = 0;
+    u32 o = 0;
+
+    while (i < n) {
+        // Skip unchanged bytes, a word at a time where possible
+        u32 start = i;
+        while (i + 8 <= n) {
+            u64 a, b;
+            memcpy(&a, prev + i, 8);
+            memcpy(&b, next + i, 8);
+            if (a != b) break;
+            i += 8;
+        }
+        while (i < n && prev[i] == next[i]) i++;
+        o += put_varint(out + o, i - start);
+
+        // Changed bytes run until at least 4 unchanged bytes in a row,
+        // so short gaps don't cost a token each
+        u32 end = i;
+        while (end < n) {
+            if (prev[end] != next[end]) {
+                end++;
+                continue;
+            }
+            u32 same = end;
+            while (same < n && same < end + 4 && prev[same] == next[same]) same++;
+            if (same == n || same == end + 4) break;
+            end = same;
+        }
+        o += put_varint(out + o, end - i);
+        for (; i < end; i++) out[o++] = prev[i] ^ next[i];
+    }
+
+    return o;
+}
+
+void RewindBuffer::decode(const u8 *in, u32 size, u8 *state) {
+    u32 pos = 0;
+    u32 i = 0;
+    while (pos < size) {
+        i += get_varint(in, pos);
+        u32 changed = get_varint(in, pos);
+        for (u32 end = i + changed; i < end; i++) state[i] ^= in[pos++];
+    }
+}
+
+void RewindBuffer::ring_write(const u8 *data, u32 size) {
+    u32 first = std::min(size, capacity - head);
+    memcpy(ring + head, data, first);
+    memcpy(ring, data + first, size - first);
+    head = (head + size) % capacity;
+}
+
+void RewindBuffer::ring_read(u32 offset, u8 *data, u32 size) {
+    u32 first = std::min(size, capacity - offset);
+    memcpy(data, ring + offset, first);
+    memcpy(data + first, ring, size - first);
+}
+
+void RewindBuffer::push(const SaveState &state) {
+    if (!has_newest) {
+        newest = state;
+        has_newest = true;
+        return;
+    }
+
+    // The delta turns this snapshot back into the previous newest one
+    u32 size = encode((u8*)&newest, (u8*)&state, scratch);
+    if (size > capacity) {
+        // Doesn't fit at all: history restarts from here
+        clear();
+        newest = state;
+        has_newest = true;
+        return;
+    }
+
+    // Drop the oldest history to make room
+    while (capacity - used < size) {
+        used -= records.front().size;
+        records.pop_front();
+    }
+
+    records.push_back({head, size});
+    ring_write(scratch, size);
+    used += size;
+    newest = state;
+}
+
+bool RewindBuffer::pop(SaveState &state) {
+    if (!has_newest) return false;
+
+    state = newest;
+
+    // Undo one delta so the next pop goes further back. The oldest
+    // snapshot is kept once history runs out.
+    if (!records.empty()) {
+        Record rec = records.back();
+        records.pop_back();
+        ring_read(rec.offset, scratch, rec.size);
+        decode(scratch, rec.size, (u8*)&newest);
+        used -= rec.size;
+        head = rec.offset;
+    }
+
+    return true;
+}
+
+void RewindBuffer::clear() {
+    records.clear();
+    head = 0;
+    used = 0;
+    has_newest = false;
+}
+
+u32 RewindBuffer::size() {
+    return records.size() + (has_newest ? 1 : 0);
+}
+
+u32 RewindBuffer::bytes_used() {
+    return used;
+}
@@ -0,0 +1,45 @@
+#ifndef REWIND_H
+#define REWIND_H
+
+#include "common.h"
+#include "save_state.h"
+
+// Fixed-size history of save states for rewinding.
+//
+// Only the newest snapshot is kept whole. Every older one is stored as
+// the XOR against its successor, run-length encoded, so the mostly
+// unchanged WRAM/VRAM/SRAM costs next to nothing per capture. Walking
+// back undoes one delta at a time; the oldest deltas are dropped once
+// the ring fills up.
+class RewindBuffer {
+    private:
+        struct Record {
+            u32 offset; // Start of the encoded delta in the ring
+            u32 size;   // Encoded size in bytes
+        };
+
+        u8 *ring;
+        u32 capacity;
+        u32 head = 0;  // Next free byte
+        u32 used = 0;  // Bytes held by records
+        std::deque<Record> records;
+
+        SaveState newest;   // Full copy of the latest snapshot
+        bool has_newest = false;
+        u8 *scratch;        // Encoding buffer, sized for the worst case
+
+        u32 encode(const u8 *prev, const u8 *next, u8 *out);
+        void decode(const u8 *in, u32 size, u8 *state);
+        void ring_write(const u8 *data, u32 size);
+        void ring_read(u32 offset, u8 *data, u32 size);
+    public:
+        RewindBuffer(u32 capacity_bytes = 8 * 1024 * 1024);
+        ~RewindBuffer();
+        void push(const SaveState &state);
+        bool pop(SaveState &state);
+        void clear();
+        u32 size();
+        u32 bytes_used();
+};
+
+#endif
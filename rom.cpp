@@ -0,0 +1,224 @@
+#include "rom.h"
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <climits>
+
+// Table for the reflected 0xEDB88320 polynomial, built at compile time
+struct Crc32Table {
+    u32 entries[256];
+    constexpr Crc32Table() : entries() {
+        for (u32 i = 0; i < 256; i++) {
+            u32 c = i;
+            for (int k = 0; k < 8; k++) c = (c & 1) ? 0xEDB88320 ^ (c >> 1) : c >> 1;
+            entries[i] = c;
+        }
+    }
+};
+constexpr Crc32Table crc32_table;
+
+u32 crc32(const u8 *data, size_t size, u32 crc) {
+    crc = ~crc;
+    for (size_t i = 0; i < size; i++) {
+        crc = crc32_table.entries[(crc ^ data[i]) & 0xFF] ^ (crc >> 8);
+    }
+    return ~crc;
+}
+
+// https://github.com/Cyan4973/xxHash/blob/dev/doc/xxhash_spec.md
+const u64 XXH_P1 = 0x9E3779B185EBCA87ULL;
+const u64 XXH_P2 = 0xC2B2AE3D27D4EB4FULL;
+const u64 XXH_P3 = 0x165667B19E3779F9ULL;
+const u64 XXH_P4 = 0x85EBCA77C2B2AE63ULL;
+const u64 XXH_P5 = 0x27D4EB2F165667C5ULL;
+
+static u64 rotl64(u64 x, int r) {
+    return (x << r) | (x >> (64 - r));
+}
+
+static u64 read64(const u8 *p) {
+    u64 v;
+    memcpy(&v, p, sizeof(v));
+    return v;
+}
+
+static u64 xxh64_round(u64 acc, u64 input) {
+    return rotl64(acc + input * XXH_P2, 31) * XXH_P1;
+}
+
+static u64 xxh64_merge(u64 acc, u64 lane) {
+    return (acc ^ xxh64_round(0, lane)) * XXH_P1 + XXH_P4;
+}
+
+u64 xxh64(const u8 *data, size_t size, u64 seed) {
+    const u8 *p = data;
+    const u8 *end = data + size;
+    u64 h;
+
+    if (size >= 32) {
+        // Four independent lanes over 32 byte stripes
+        u64 v1 = seed + XXH_P1 + XXH_P2;
+        u64 v2 = seed + XXH_P2;
+        u64 v3 = seed;
+        u64 v4 = seed - XXH_P1;
+        for (; p + 32 <= end; p += 32) {
+            v1 = xxh64_round(v1, read64(p));
+            v2 = xxh64_round(v2, read64(p + 8));
+            v3 = xxh64_round(v3, read64(p + 16));
+            v4 = xxh64_round(v4, read64(p + 24));
+        }
+        h = rotl64(v1, 1) + rotl64(v2, 7) + rotl64(v3, 12) + rotl64(v4, 18);
+        h = xxh64_merge(h, v1);
+        h = xxh64_merge(h, v2);
+        h = xxh64_merge(h, v3);
+        h = xxh64_merge(h, v4);
+    } else {
+        h = seed + XXH_P5;
+    }
+    h += size;
+
+    for (; p + 8 <= end; p += 8) h = rotl64(h ^ xxh64_round(0, read64(p)), 27) * XXH_P1 + XXH_P4;
+    if (p + 4 <= end) {
+        u32 v;
+        memcpy(&v, p, sizeof(v));
+        h = rotl64(h ^ (v * XXH_P1), 23) * XXH_P2 + XXH_P3;
+        p += 4;
+    }
+    for (; p < end; p++) h = rotl64(h ^ (*p * XXH_P5), 11) * XXH_P1;
+
+    h ^= h >> 33;
+    h *= XXH_P2;
+    h ^= h >> 29;
+    h *= XXH_P3;
+    h ^= h >> 32;
+    return h;
+}
+
+RomImage::RomImage() {}
+
+RomImage::~RomImage() {
+    if (map) munmap(map, size);
+    if (heap) delete[] heap;
+}
+
+bool RomImage::map_file(const char *path) {
+    int fd = open(path, O_RDONLY);
+    if (fd < 0) {
+        std::cout << "ROM failed to open\n";
+        return false;
+    }
+
+    struct stat st;
+    if (fstat(fd, &st) != 0 || st.st_size == 0 || st.st_size > 0xFFFFFFFF) {
+        std::cout << "ROM has an unusable size\n";
+        ::close(fd);
+        return false;
+    }
+
+    // Private and read-only: nothing we do can reach the file
+    void *addr = mmap(nullptr, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    ::close(fd);
+    if (addr == MAP_FAILED) {
+        std::cout << "ROM failed to map\n";
+        return false;
+    }
+
+    map = addr;
+    data = (const u8*)addr;
+    size = st.st_size;
+    inode = st.st_ino;
+    mtime = st.st_mtime;
+    crc = crc32(data, size);
+    return true;
+}
+
+bool RomImage::copy(const u8 *src, u32 size_) {
+    if (size_ == 0) return false;
+    heap = new u8[size_];
+    memcpy(heap, src, size_);
+    data = heap;
+    size = size_;
+    crc = crc32(data, size);
+    return true;
+}
+
+bool RomImage::same_file(u64 inode_, u64 size_, u64 mtime_) {
+    return map && inode == inode_ && size == size_ && mtime == mtime_;
+}
+
+const u8 *RomImage::get_data() {
+    return data;
+}
+
+u32 RomImage::get_size() {
+    return size;
+}
+
+u32 RomImage::get_crc() {
+    return crc;
+}
+
+RomRegistry::RomRegistry() {}
+
+RomRegistry::~RomRegistry() {}
+
+RomRegistry &RomRegistry::instance() {
+    static RomRegistry registry;
+    return registry;
+}
+
+void RomRegistry::prune() {
+    // Drop images nobody uses anymore, so the maps don't keep growing
+    for (auto it = by_path.begin(); it != by_path.end();) {
+        if (it->second.expired()) it = by_path.erase(it);
+        else ++it;
+    }
+    for (auto it = by_content.begin(); it != by_content.end();) {
+        if (it->second.expired()) it = by_content.erase(it);
+        else ++it;
+    }
+}
+
+std::shared_ptr<RomImage> RomRegistry::find_content(const std::shared_ptr<RomImage> &image) {
+    // Hand out an identical image that is already loaded, or register this one
+    prune();
+    u64 key = ((u64)image->get_crc() << 32) | image->get_size();
+    std::shared_ptr<RomImage> existing = by_content[key].lock();
+    if (existing && existing->get_size() == image->get_size()
+        && memcmp(existing->get_data(), image->get_data(), image->get_size()) == 0) {
+        return existing;
+    }
+    by_content[key] = image;
+    return image;
+}
+
+std::shared_ptr<RomImage> RomRegistry::open(const char *path) {
+    char real[PATH_MAX];
+    struct stat st;
+    if (!realpath(path, real) || stat(real, &st) != 0) {
+        std::cout << "ROM failed to open\n";
+        return nullptr;
+    }
+
+    std::lock_guard<std::mutex> guard(lock);
+
+    // Same file, and it hasn't changed since it was mapped
+    std::shared_ptr<RomImage> image = by_path[real].lock();
+    if (image && image->same_file(st.st_ino, st.st_size, st.st_mtime)) return image;
+
+    image = std::make_shared<RomImage>();
+    if (!image->map_file(real)) return nullptr;
+
+    image = find_content(image);
+    by_path[real] = image;
+    return image;
+}
+
+std::shared_ptr<RomImage> RomRegistry::share(const u8 *data, u32 size) {
+    std::shared_ptr<RomImage> image = std::make_shared<RomImage>();
+    if (!image->copy(data, size)) return nullptr;
+
+    std::lock_guard<std::mutex> guard(lock);
+    return find_content(image);
+}
@@ -0,0 +1,60 @@
+#ifndef ROM_H
+#define ROM_H
+
+#include "common.h"
+#include <memory>
+#include <mutex>
+#include <map>
+
+u32 crc32(const u8 *data, size_t size, u32 crc = 0);
+u64 xxh64(const u8 *data, size_t size, u64 seed = 0); // Much faster for big inputs
+
+// Read-only ROM contents. Files are mapped straight from the page cache,
+// so every instance sharing an image also shares the physical pages.
+class RomImage {
+    private:
+        const u8 *data = nullptr;
+        u32 size = 0;
+        u32 crc = 0;
+
+        void *map = nullptr; // Set when the data is an mmap of a file
+        u8 *heap = nullptr;  // Set when the data is our own copy
+
+        // Identifies which version of the file was mapped
+        u64 inode = 0;
+        u64 mtime = 0;
+    public:
+        RomImage();
+        ~RomImage();
+        bool map_file(const char *path);
+        bool copy(const u8 *src, u32 size_);
+        bool same_file(u64 inode_, u64 size_, u64 mtime_);
+
+        const u8 *get_data();
+        u32 get_size();
+        u32 get_crc();
+};
+
+// Process-wide cache of loaded ROMs.
+//
+// Images are looked up by path first and then by content, so the same
+// game loaded through different paths or from memory still maps once.
+// Only weak references are held here: an image goes away with the last
+// Cartridge using it.
+class RomRegistry {
+    private:
+        std::mutex lock;
+        std::map<std::string, std::weak_ptr<RomImage>> by_path;
+        std::map<u64, std::weak_ptr<RomImage>> by_content; // CRC32 and size
+
+        std::shared_ptr<RomImage> find_content(const std::shared_ptr<RomImage> &image);
+        void prune();
+        RomRegistry();
+    public:
+        ~RomRegistry();
+        static RomRegistry &instance();
+        std::shared_ptr<RomImage> open(const char *path);
+        std::shared_ptr<RomImage> share(const u8 *data, u32 size);
+};
+
+#endif
@@ -0,0 +1,50 @@
+#include "save_state.h"
+
+bool SaveState::valid() const {
+    return magic == SAVE_STATE_MAGIC 
+        && version == SAVE_STATE_VERSION 
+        && size == sizeof(SaveState);
+}
+
+bool SaveState::save_file(const char *path) {
+    TRACE_ZONE("save state write");
+    std::ofstream ofs;
+    ofs.open(path, std::ios::binary);
+    if (ofs.fail()) {
+        std::cout << "State file failed to be created\n";
+        return false;
+    }
+
+    // The whole state is written in one go
+    ofs.write((char*)this, sizeof(SaveState));
+    ofs.close();
+
+    if (ofs.fail()) {
+        std::cout << "State file could not be written\n";
+        return false;
+    }
+
+    return true;
+}
+
+bool SaveState::load_file(const char *path) {
+    TRACE_ZONE("save state read");
+    std::ifstream ifs;
+    ifs.open(path, std::ios::binary);
+    if (ifs.fail()) {
+        std::cout << "State file failed to open\n";
+        return false;
+    }
+
+    // Read into a scratch copy so a bad file leaves this state untouched
+    SaveState tmp;
+    ifs.read((char*)&tmp, sizeof(SaveState));
+    if (ifs.gcount() != sizeof(SaveState) || !tmp.valid()) {
+        std::cout << "State file is not a compatible save state\n";
+        return false;
+    }
+    ifs.close();
+
+    *this = tmp;
+    return true;
+}
@@ -0,0 +1,124 @@
+#ifndef SAVE_STATE_H
+#define SAVE_STATE_H
+
+#include "common.h"
+#include "machine_state.h"
+#include "trace.h"
+#include <type_traits>
+
+// Save states are memcpy'd to and from disk as-is, so the layout below
+// is the file format: fixed-size fields, little-endian, no pointers.
+static_assert(__BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__,
+    "Save state format assumes a little-endian host");
+
+const u32 SAVE_STATE_MAGIC = 0x54534247; // "GBST"
+const u32 SAVE_STATE_VERSION = 3;        // Bump whenever the layout changes
+
+// Bump whenever emulation changes what any game does, layout or not.
+// Snapshots made by an older core are stale even if they still load.
+const u32 CORE_VERSION = 2;
+
+struct JoypadState {
+    // Only the select lines are machine state: button levels come from the host
+    u8 buttons_select;
+    u8 dpad_select;
+    u8 pad[2] = {0};
+};
+
+struct PpuState {
+    u8 vram[0x2000];
+    u8 oam[0xA0];
+    u8 lcd_buf[144][160];
+    u8 sprite_buffer[10];
+    u8 sprite_count;
+    u8 pad = 0;
+};
+
+struct RamState {
+    u8 wram[0x2000];
+    u8 hram[0x80];
+};
+
+struct SquareState {
+    u8 enabled;
+    u8 dac_enabled;
+    u8 duty_pos;
+    u8 volume;
+    u8 env_timer;
+    u8 sweep_timer;   // Sweep fields are only used by channel 1
+    u8 sweep_enabled;
+    u8 pad;
+    u16 length;
+    u16 shadow_freq;
+    u32 timer;        // T-cycles until the next duty step
+};
+
+struct WaveState {
+    u8 enabled;
+    u8 dac_enabled;
+    u8 pos;
+    u8 sample;
+    u16 length;
+    u16 pad;
+    u32 timer;        // T-cycles until the next wave RAM step
+};
+
+struct NoiseState {
+    u8 enabled;
+    u8 dac_enabled;
+    u8 volume;
+    u8 env_timer;
+    u16 length;
+    u16 lfsr;
+    u32 timer;        // T-cycles until the next LFSR shift
+};
+
+struct ApuState {
+    u8 regs[0x30];    // 0xFF10-0xFF3F as written, wave RAM included
+    SquareState square[2];
+    WaveState wave;
+    NoiseState noise;
+    u8 fs_step;       // Frame sequencer step, 0-7
+    u8 pad[7];
+    u64 time;         // Clock the channels have been synthesized up to
+    u64 next_fs;      // Clock of the next frame sequencer step
+};
+
+struct CartState {
+    u8 rom_bank_num;
+    u8 ram_bank_num;
+    u8 enable_ram;
+    u8 mode_flag;
+    u8 sram[0x2000 * 4];
+};
+
+struct SaveState {
+    // Header
+    u32 magic = SAVE_STATE_MAGIC;
+    u32 version = SAVE_STATE_VERSION;
+    u32 size = sizeof(SaveState);
+    u8 cart_type = 0;      // Cartridge header 0x147
+    u8 pad = 0;
+    u16 rom_checksum = 0;  // Cartridge header 0x14E-0x14F
+    u8 reserved[48] = {0}; // Machine state starts on a cache line
+
+    // Machine
+    MachineState machine;
+    JoypadState joypad;
+    RamState ram;
+    PpuState ppu;
+    ApuState apu;
+    CartState cart;
+    u8 tail[12] = {0};     // Rounds the size up to a whole cache line
+
+    bool valid() const;
+    bool save_file(const char *path);
+    bool load_file(const char *path);
+};
+
+static_assert(std::is_trivially_copyable<SaveState>::value,
+    "SaveState is copied in bulk and must stay trivially copyable");
+static_assert(std::has_unique_object_representations<SaveState>::value,
+    "SaveState must not contain implicit padding");
+
+#endif
@@ -0,0 +1,395 @@
+#include "cpu.h"
+#include "flat_bus.h"
+#include "thread_pool.h"
+#include <memory>
+#include <chrono>
+#include <sstream>
+#include <vector>
+#include <ftw.h>
+
+// gb-sm83: runs the single-step SM83 tests against the CPU core.
+//
+//     gb-sm83 [-j threads] [-v] path...
+//
+// Paths are .json files or directories searched for them, one file per
+// opcode as in https://github.com/SingleStepTests/sm83. Every test gives
+// the registers and memory before and after one instruction, plus what
+// was on the bus in each M-cycle. The CPU runs it on a flat 64 KB bus
+// (FlatBus) and has to match all three: registers, memory,
+// and the same reads and writes in the same M-cycles. Files are spread
+// over every core; -v lists every failing test instead of the first in
+// each file.
+
+// Just enough JSON for the test files
+struct Json {
+    enum { Null, Number, String, Array, Object } type = Null;
+    double num = 0;
+    std::string str;
+    std::vector<Json> items;
+    std::vector<std::pair<std::string, Json>> fields;
+
+    const Json *get(const char *key) const {
+        for (const auto &field : fields) {
+            if (field.first == key) return &field.second;
+        }
+        return nullptr;
+    }
+};
+
+struct JsonParser {
+    const char *p;
+    const char *end;
+    bool ok = true;
+
+    void skip() {
+        while (p < end && isspace((unsigned char)*p)) p++;
+    }
+
+    bool expect(char c) {
+        skip();
+        if (p < end && *p == c) {
+            p++;
+            return true;
+        }
+        ok = false;
+        return false;
+    }
+
+    void parse_string(std::string &out) {
+        if (!expect('"')) return;
+        while (p < end && *p != '"') {
+            if (*p == '\\' && p + 1 < end) p++; // Test files need no more than this
+            out += *p++;
+        }
+        expect('"');
+    }
+
+    void parse(Json &v) {
+        skip();
+        if (p >= end) {
+            ok = false;
+            return;
+        }
+        if (*p == '{') {
+            v.type = Json::Object;
+            p++;
+            skip();
+            if (p < end && *p == '}') { p++; return; }
+            while (ok) {
+                v.fields.emplace_back();
+                parse_string(v.fields.back().first);
+                expect(':');
+                parse(v.fields.back().second);
+                skip();
+                if (p < end && *p == ',') { p++; continue; }
+                expect('}');
+                break;
+            }
+        } else if (*p == '[') {
+            v.type = Json::Array;
+            p++;
+            skip();
+            if (p < end && *p == ']') { p++; return; }
+            while (ok) {
+                v.items.emplace_back();
+                parse(v.items.back());
+                skip();
+                if (p < end && *p == ',') { p++; continue; }
+                expect(']');
+                break;
+            }
+        } else if (*p == '"') {
+            v.type = Json::String;
+            parse_string(v.str);
+        } else if (end - p >= 4 && !strncmp(p, "null", 4)) {
+            p += 4;
+        } else if (end - p >= 4 && !strncmp(p, "true", 4)) {
+            v.type = Json::Number;
+            v.num = 1;
+            p += 4;
+        } else if (end - p >= 5 && !strncmp(p, "false", 5)) {
+            v.type = Json::Number;
+            p += 5;
+        } else {
+            char *next;
+            v.type = Json::Number;
+            v.num = strtod(p, &next);
+            if (next == p) ok = false;
+            p = next;
+        }
+    }
+};
+
+struct CpuSnapshot {
+    Registers regs;
+    int ime = -1; // -1 when the test leaves it out
+    int ei = -1;  // EI pending, only in some versions of the tests
+    std::vector<std::pair<u16, u8>> ram;
+};
+
+struct StepTest {
+    std::string name;
+    CpuSnapshot initial;
+    CpuSnapshot final;
+    std::vector<BusAccess> accesses; // The cycles that used the bus
+    u32 cycles = 0;
+};
+
+struct TestFile {
+    std::string path;
+
+    // Filled in by whichever worker runs it
+    bool loaded = false;
+    int passed = 0;
+    int failed = 0;
+    std::vector<std::string> failures;
+};
+
+// The CPU on a flat bus, which is all it needs
+struct TestMachine {
+    MachineState state;
+    u8 mem[0x10000];
+    std::vector<BusAccess> log;
+    FlatBus bus;
+    CpuCore<FlatBus> cpu;
+
+    TestMachine() : bus(state, mem, log), cpu(state, bus) {
+        memset(mem, 0, sizeof(mem));
+    }
+};
+
+std::vector<TestFile> *found_files = nullptr; // nftw has no user pointer
+
+int add_file(const char *path, const struct stat *, int type, struct FTW *) {
+    std::string name = path;
+    if (type == FTW_F && name.size() > 5 && name.compare(name.size() - 5, 5, ".json") == 0) {
+        TestFile file;
+        file.path = name;
+        found_files->push_back(file);
+    }
+    return 0;
+}
+
+int field(const Json &obj, const char *key, int missing = -1) {
+    const Json *v = obj.get(key);
+    return v && v->type == Json::Number ? (int)v->num : missing;
+}
+
+bool read_snapshot(const Json *obj, CpuSnapshot &s) {
+    if (!obj || obj->type != Json::Object) return false;
+    s.regs.A = field(*obj, "a", 0);
+    s.regs.F = field(*obj, "f", 0);
+    s.regs.B = field(*obj, "b", 0);
+    s.regs.C = field(*obj, "c", 0);
+    s.regs.D = field(*obj, "d", 0);
+    s.regs.E = field(*obj, "e", 0);
+    s.regs.H = field(*obj, "h", 0);
+    s.regs.L = field(*obj, "l", 0);
+    s.regs.PC = field(*obj, "pc", 0);
+    s.regs.SP = field(*obj, "sp", 0);
+    s.ime = field(*obj, "ime");
+    s.ei = field(*obj, "ei");
+
+    const Json *ram = obj->get("ram");
+    if (!ram || ram->type != Json::Array) return false;
+    for (const Json &pair : ram->items) {
+        if (pair.items.size() != 2) return false;
+        s.ram.push_back({(u16)pair.items[0].num, (u8)pair.items[1].num});
+    }
+    return true;
+}
+
+bool load_tests(const std::string &path, std::vector<StepTest> &tests) {
+    std::ifstream ifs(path, std::ios::binary);
+    if (ifs.fail()) return false;
+    std::string text((std::istreambuf_iterator<char>(ifs)), std::istreambuf_iterator<char>());
+
+    Json root;
+    JsonParser parser = {text.data(), text.data() + text.size()};
+    parser.parse(root);
+    if (!parser.ok || root.type != Json::Array) return false;
+
+    for (const Json &t : root.items) {
+        StepTest test;
+        const Json *name = t.get("name");
+        test.name = name ? name->str : "?";
+        if (!read_snapshot(t.get("initial"), test.initial) || !read_snapshot(t.get("final"), test.final)) {
+            return false;
+        }
+
+        // Each cycle is null or [addr, value, "r-m" / "-wm" / ...];
+        // the ones that neither read nor write are internal
+        const Json *cycles = t.get("cycles");
+        if (!cycles || cycles->type != Json::Array) return false;
+        test.cycles = cycles->items.size();
+        for (u32 i = 0; i < test.cycles; i++) {
+            const Json &c = cycles->items[i];
+            if (c.items.size() < 3 || c.items[0].type != Json::Number) continue;
+            const std::string &kind = c.items[2].str;
+            bool reads = kind.find('r') != std::string::npos;
+            bool writes = kind.find('w') != std::string::npos;
+            if (reads || writes) {
+                test.accesses.push_back({i, (u16)c.items[0].num, (u8)c.items[1].num, writes});
+            }
+        }
+        tests.push_back(std::move(test));
+    }
+    return true;
+}
+
+std::string hex(int val, int width) {
+    std::ostringstream out;
+    out << std::hex << std::setw(width) << std::setfill('0') << val;
+    return out.str();
+}
+
+std::string describe(const BusAccess &a) {
+    return "cycle " + std::to_string(a.cycle) + " " + (a.write ? "write " : "read ")
+        + hex(a.addr, 4) + "=" + hex(a.val, 2);
+}
+
+// Empty when the CPU got it right, otherwise what it got wrong
+std::string run_test(TestMachine &m, const StepTest &test) {
+    m.state = MachineState();
+    m.state.regs = test.initial.regs;
+    m.state.ctx.IME = test.initial.ime > 0;
+    m.state.ctx.IME_next = test.initial.ei > 0;
+    m.state.IE = 0; // No interrupts get in the way of the one instruction
+    m.state.IF = 0;
+    m.state.cycles = 0;
+    for (const auto &cell : test.initial.ram) m.mem[cell.first] = cell.second;
+    m.log.clear();
+
+    bool stepped = m.cpu.step();
+
+    std::string error;
+    const Registers &r = m.state.regs;
+    const Registers &want = test.final.regs;
+    const char *names[] = {"A", "F", "B", "C", "D", "E", "H", "L"};
+    const u8 got8[] = {r.A, r.F, r.B, r.C, r.D, r.E, r.H, r.L};
+    const u8 want8[] = {want.A, want.F, want.B, want.C, want.D, want.E, want.H, want.L};
+    if (!stepped) error += " could not step;";
+    for (int i = 0; i < 8; i++) {
+        if (got8[i] != want8[i]) error += std::string(" ") + names[i] + "=" + hex(got8[i], 2) + " not " + hex(want8[i], 2) + ";";
+    }
+    if (r.PC != want.PC) error += " PC=" + hex(r.PC, 4) + " not " + hex(want.PC, 4) + ";";
+    if (r.SP != want.SP) error += " SP=" + hex(r.SP, 4) + " not " + hex(want.SP, 4) + ";";
+
+    // A pending EI only shows up as IME by the next instruction, so it
+    // counts as set unless the test tracks it on its own
+    if (test.final.ime >= 0) {
+        bool ime = m.state.ctx.IME || (test.final.ei < 0 && m.state.ctx.IME_next);
+        if (ime != (test.final.ime > 0)) error += " IME=" + std::to_string(ime) + ";";
+    }
+    if (test.final.ei >= 0 && m.state.ctx.IME_next != (test.final.ei > 0)) {
+        error += " EI pending=" + std::to_string(m.state.ctx.IME_next) + ";";
+    }
+
+    for (const auto &cell : test.final.ram) {
+        if (m.mem[cell.first] != cell.second) {
+            error += " [" + hex(cell.first, 4) + "]=" + hex(m.mem[cell.first], 2) + " not " + hex(cell.second, 2) + ";";
+        }
+    }
+
+    u32 cycles = m.state.cycles >> 2;
+    if (cycles != test.cycles) {
+        error += " " + std::to_string(cycles) + " M-cycles not " + std::to_string(test.cycles) + ";";
+    }
+    size_t n = std::max(m.log.size(), test.accesses.size());
+    for (size_t i = 0; i < n; i++) {
+        if (i >= m.log.size()) {
+            error += " missing " + describe(test.accesses[i]) + ";";
+            break;
+        }
+        if (i >= test.accesses.size()) {
+            error += " extra " + describe(m.log[i]) + ";";
+            break;
+        }
+        const BusAccess &a = m.log[i];
+        const BusAccess &b = test.accesses[i];
+        if (a.cycle != b.cycle || a.addr != b.addr || a.val != b.val || a.write != b.write) {
+            error += " " + describe(a) + " not " + describe(b) + ";";
+            break;
+        }
+    }
+
+    // Leave memory zeroed for the next test
+    for (const auto &cell : test.initial.ram) m.mem[cell.first] = 0;
+    for (const auto &cell : test.final.ram) m.mem[cell.first] = 0;
+    for (const BusAccess &a : m.log) m.mem[a.addr] = 0;
+    return error;
+}
+
+void run_file(TestFile &file, std::unique_ptr<TestMachine> &machine, bool verbose) {
+    std::vector<StepTest> tests;
+    if (!load_tests(file.path, tests)) return;
+    file.loaded = true;
+
+    if (!machine) machine.reset(new TestMachine());
+    for (const StepTest &test : tests) {
+        std::string error = run_test(*machine, test);
+        if (error.empty()) {
+            file.passed++;
+            continue;
+        }
+        file.failed++;
+        if (verbose || file.failures.empty()) file.failures.push_back(test.name + ":" + error);
+    }
+}
+
+int main(int argc, char** argv) {
+    int threads = 0;
+    bool verbose = false;
+    int opt;
+    while ((opt = getopt(argc, argv, "j:v")) != -1) {
+        switch (opt) {
+            case 'j': threads = atoi(optarg); break;
+            case 'v': verbose = true; break;
+        }
+    }
+    if (optind >= argc) {
+        std::cout << "usage: gb-sm83 [-j threads] [-v] path...\n";
+        return -1;
+    }
+
+    std::vector<TestFile> files;
+    found_files = &files;
+    for (int i = optind; i < argc; i++) {
+        if (nftw(argv[i], add_file, 16, FTW_PHYS) != 0) {
+            std::cout << "Could not search " << argv[i] << std::endl;
+            return -1;
+        }
+    }
+    std::sort(files.begin(), files.end(), [](const TestFile &a, const TestFile &b) { return a.path < b.path; });
+
+    auto start = std::chrono::steady_clock::now();
+    {
+        ThreadPool pool(threads);
+        std::vector<std::unique_ptr<TestMachine>> machines(pool.size());
+        for (TestFile &file : files) {
+            pool.submit([&file, &machines, verbose](int w) { run_file(file, machines[w], verbose); });
+        }
+        pool.wait();
+        threads = pool.size();
+    }
+    std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+
+    int passed = 0, failed = 0, bad_files = 0;
+    for (TestFile &file : files) {
+        passed += file.passed;
+        failed += file.failed;
+        if (!file.loaded) {
+            bad_files++;
+            std::cout << "ERROR " << file.path << " (could not be read as a test file)\n";
+        } else if (file.failed) {
+            std::cout << "FAIL  " << file.path << " (" << file.failed << " of " << file.passed + file.failed << ")\n";
+            for (const std::string &failure : file.failures) std::cout << "      " << failure << "\n";
+        }
+    }
+
+    std::cout << std::fixed << std::setprecision(1) << files.size() << " files, " << passed + failed
+        << " tests: " << passed << " passed, " << failed << " failed, " << bad_files << " unreadable in "
+        << elapsed.count() << " s on " << threads << " threads\n";
+
+    return failed == 0 && bad_files == 0 ? 0 : -2;
+}
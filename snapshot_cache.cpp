@@ -0,0 +1,131 @@
+#include "snapshot_cache.h"
+#include "rom.h"
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <thread>
+#include <functional>
+
+const u32 SNAPSHOT_MAGIC = 0x53574247; // "GBWS"
+
+// Leads every entry file; the state follows at the next 64 byte boundary
+struct SnapshotHeader {
+    u32 magic;
+    u32 state_version;
+    u32 state_size;
+    u32 rom_crc;
+    u32 rom_size;
+    u32 input_crc;
+    u64 frames;
+    u32 core_version;
+    u8 reserved[28];
+};
+
+static_assert(sizeof(SnapshotHeader) == 64, "Snapshot header should be one cache line");
+static_assert(sizeof(SnapshotHeader) % alignof(SaveState) == 0,
+    "A mapped snapshot must be usable in place");
+
+SnapshotKey::SnapshotKey(u32 rom_crc_, u32 rom_size_, const StartSpec &spec)
+    : rom_crc(rom_crc_), rom_size(rom_size_), frames(spec.frames) {
+    // Inputs past the last frame run are never seen, so they don't count
+    size_t used = std::min<u64>(spec.inputs.size(), spec.frames);
+    input_crc = crc32(spec.inputs.data(), used);
+}
+
+SnapshotEntry::SnapshotEntry() {}
+
+SnapshotEntry::~SnapshotEntry() {
+    if (map) munmap(map, length);
+}
+
+bool SnapshotEntry::open(const std::string &path, const SnapshotKey &key) {
+    int fd = ::open(path.c_str(), O_RDONLY);
+    if (fd < 0) return false;
+
+    struct stat st;
+    size_t expected = sizeof(SnapshotHeader) + sizeof(SaveState);
+    if (fstat(fd, &st) != 0 || (size_t)st.st_size != expected) {
+        ::close(fd);
+        return false;
+    }
+
+    void *addr = mmap(nullptr, expected, PROT_READ, MAP_PRIVATE, fd, 0);
+    ::close(fd);
+    if (addr == MAP_FAILED) return false;
+
+    // Entries from another state layout, an older core or a colliding
+    // name are misses
+    const SnapshotHeader *header = (const SnapshotHeader*)addr;
+    const SaveState *save = (const SaveState*)((const u8*)addr + sizeof(SnapshotHeader));
+    if (header->magic != SNAPSHOT_MAGIC || header->state_version != SAVE_STATE_VERSION
+        || header->state_size != sizeof(SaveState) || header->rom_crc != key.rom_crc
+        || header->rom_size != key.rom_size || header->input_crc != key.input_crc
+        || header->frames != key.frames || header->core_version != key.core_version
+        || !save->valid()) {
+        munmap(addr, expected);
+        return false;
+    }
+
+    if (map) munmap(map, length);
+    map = addr;
+    length = expected;
+    state = save;
+    return true;
+}
+
+const SaveState *SnapshotEntry::get() {
+    return state;
+}
+
+SnapshotCache::SnapshotCache(const std::string &dir_) : dir(dir_) {
+    mkdir(dir.c_str(), 0755); // Fine if it already exists
+}
+
+SnapshotCache::~SnapshotCache() {}
+
+std::string SnapshotCache::path(const SnapshotKey &key) {
+    char name[80];
+    snprintf(name, sizeof(name), "/%08x-%x-%llu-%08x-c%u.gbws", key.rom_crc, key.rom_size,
+        (unsigned long long)key.frames, key.input_crc, key.core_version);
+    return dir + name;
+}
+
+bool SnapshotCache::fetch(const SnapshotKey &key, SnapshotEntry &entry) {
+    return entry.open(path(key), key);
+}
+
+bool SnapshotCache::store(const SnapshotKey &key, const SaveState &save) {
+    SnapshotHeader header;
+    memset(&header, 0, sizeof(header));
+    header.magic = SNAPSHOT_MAGIC;
+    header.state_version = SAVE_STATE_VERSION;
+    header.state_size = sizeof(SaveState);
+    header.rom_crc = key.rom_crc;
+    header.rom_size = key.rom_size;
+    header.input_crc = key.input_crc;
+    header.frames = key.frames;
+    header.core_version = key.core_version;
+
+    // Unique per process and thread, so writers never share a file
+    std::string final_path = path(key);
+    std::string tmp_path = final_path + ".tmp" + std::to_string(getpid()) + "-"
+        + std::to_string(std::hash<std::thread::id>()(std::this_thread::get_id()));
+
+    std::ofstream ofs;
+    ofs.open(tmp_path, std::ios::binary);
+    if (ofs.fail()) {
+        std::cout << "Snapshot cache entry failed to be created\n";
+        return false;
+    }
+    ofs.write((char*)&header, sizeof(header));
+    ofs.write((char*)&save, sizeof(save));
+    ofs.close();
+
+    if (ofs.fail() || rename(tmp_path.c_str(), final_path.c_str()) != 0) {
+        std::cout << "Snapshot cache entry could not be written\n";
+        unlink(tmp_path.c_str());
+        return false;
+    }
+    return true;
+}
@@ -0,0 +1,56 @@
+#ifndef SNAPSHOT_CACHE_H
+#define SNAPSHOT_CACHE_H
+
+#include "common.h"
+#include "save_state.h"
+#include <vector>
+
+// Where a warm start resumes: power on, then this many frames with the
+// given joypad masks (one per frame; frames past the end hold nothing)
+struct StartSpec {
+    u64 frames = 0;
+    std::vector<u8> inputs;
+};
+
+// Identifies one cached snapshot
+struct SnapshotKey {
+    u32 rom_crc = 0;
+    u32 rom_size = 0;
+    u64 frames = 0;
+    u32 input_crc = 0;
+    u32 core_version = CORE_VERSION;
+
+    SnapshotKey(u32 rom_crc_, u32 rom_size_, const StartSpec &spec);
+};
+
+// A cache entry mapped read-only. The state is used in place, straight
+// from the page cache, and stays valid while the entry lives.
+class SnapshotEntry {
+    private:
+        void *map = nullptr;
+        size_t length = 0;
+        const SaveState *state = nullptr;
+    public:
+        SnapshotEntry();
+        ~SnapshotEntry();
+        bool open(const std::string &path, const SnapshotKey &key);
+        const SaveState *get();
+};
+
+// Directory of post-start snapshots shared by every process using it.
+//
+// Entries are written to a temporary file and renamed into place, so
+// concurrent jobs never see half a snapshot; if two of them miss at once
+// both write and the last rename wins with an identical file.
+class SnapshotCache {
+    private:
+        std::string dir;
+    public:
+        SnapshotCache(const std::string &dir_);
+        ~SnapshotCache();
+        std::string path(const SnapshotKey &key);
+        bool fetch(const SnapshotKey &key, SnapshotEntry &entry);
+        bool store(const SnapshotKey &key, const SaveState &save);
+};
+
+#endif
@@ -0,0 +1,93 @@
+#include "thread_pool.h"
+
+ThreadPool::ThreadPool(int threads) {
+    if (threads <= 0) threads = std::max(1u, std::thread::hardware_concurrency());
+
+    for (int i = 0; i < threads; i++) queues.push_back(new Queue);
+    for (int i = 0; i < threads; i++) workers.emplace_back(&ThreadPool::run, this, i);
+}
+
+ThreadPool::~ThreadPool() {
+    wait();
+    {
+        std::lock_guard<std::mutex> guard(idle_lock);
+        stopping = true;
+    }
+    wake.notify_all();
+    for (std::thread &worker : workers) worker.join();
+    for (Queue *queue : queues) delete queue;
+}
+
+void ThreadPool::submit(Task task) {
+    // Counted under the lock sleeping workers check, so none can miss it.
+    // A worker that wakes before the push below just looks again.
+    {
+        std::lock_guard<std::mutex> guard(idle_lock);
+        pending++;
+        queued++;
+    }
+
+    // Spread tasks out up front; stealing evens out whatever is left
+    Queue *queue = queues[next_queue++ % queues.size()];
+    {
+        std::lock_guard<std::mutex> guard(queue->lock);
+        queue->tasks.push_back(std::move(task));
+    }
+    wake.notify_one();
+}
+
+bool ThreadPool::pop(int worker, Task &task) {
+    // Own queue first, newest end
+    Queue *own = queues[worker];
+    {
+        std::lock_guard<std::mutex> guard(own->lock);
+        if (!own->tasks.empty()) {
+            task = std::move(own->tasks.back());
+            own->tasks.pop_back();
+            queued--;
+            return true;
+        }
+    }
+
+    // Then steal from the others, oldest end
+    int n = queues.size();
+    for (int i = 1; i < n; i++) {
+        Queue *victim = queues[(worker + i) % n];
+        std::lock_guard<std::mutex> guard(victim->lock);
+        if (!victim->tasks.empty()) {
+            task = std::move(victim->tasks.front());
+            victim->tasks.pop_front();
+            queued--;
+            return true;
+        }
+    }
+    return false;
+}
+
+void ThreadPool::run(int worker) {
+    Task task;
+    while (true) {
+        if (pop(worker, task)) {
+            task(worker);
+            task = nullptr;
+
+            std::lock_guard<std::mutex> guard(idle_lock);
+            if (--pending == 0) done.notify_all();
+            continue;
+        }
+
+        // Nothing anywhere: sleep until more is submitted
+        std::unique_lock<std::mutex> guard(idle_lock);
+        wake.wait(guard, [this] { return stopping || queued > 0; });
+        if (stopping) return;
+    }
+}
+
+void ThreadPool::wait() {
+    std::unique_lock<std::mutex> guard(idle_lock);
+    done.wait(guard, [this] { return pending == 0; });
+}
+
+int ThreadPool::size() {
+    return workers.size();
+}
@@ -0,0 +1,48 @@
+#ifndef THREAD_POOL_H
+#define THREAD_POOL_H
+
+#include "common.h"
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <functional>
+#include <atomic>
+
+// Work-stealing thread pool.
+//
+// Every worker has its own queue. Workers take their newest task first
+// (it's the most likely to still be in cache) and, when they run dry,
+// steal the oldest task from someone else. Tasks get the index of the
+// worker running them, so callers can keep per-worker objects around.
+class ThreadPool {
+    public:
+        typedef std::function<void(int)> Task;
+    private:
+        struct Queue {
+            std::mutex lock;
+            std::deque<Task> tasks;
+        };
+
+        std::vector<std::thread> workers;
+        std::vector<Queue*> queues;
+        std::atomic<u32> next_queue{0}; // Round robin for submit()
+
+        std::mutex idle_lock;
+        std::condition_variable wake;   // Tasks arrived or shutting down
+        std::condition_variable done;   // Everything finished
+        u64 pending = 0;                // Submitted but not finished, under idle_lock
+        std::atomic<u64> queued{0};     // Sitting in a queue, raised under idle_lock
+        bool stopping = false;
+
+        bool pop(int worker, Task &task);
+        void run(int worker);
+    public:
+        ThreadPool(int threads = 0); // 0 uses every core
+        ~ThreadPool();
+        void submit(Task task);
+        void wait();
+        int size();
+};
+
+#endif
@@ -1,6 +1,6 @@
 #include "timer.h"
 
-Timer::Timer() {}
+Timer::Timer(MachineState &state_) : state(state_) {}
 Timer::~Timer() {}
 
 bool Timer::tick() {
@@ -8,7 +8,7 @@ bool Timer::tick() {
     
     // Get bit position from DIV determined by TAC
     u16 bit_pos = 0;
-    u8 clock_select = TAC & 0b11;
+    u8 clock_select = state.TAC & 0b11;
     switch (clock_select) {
         case 0b00: bit_pos = (1 << 9); break;
         case 0b01: bit_pos = (1 << 3); break;
@@ -16,21 +16,21 @@ bool Timer::tick() {
         case 0b11: bit_pos = (1 << 7); break;
     }
 
-    u8 timer_enabled = TAC & 0b100; 
-    u16 prev_DIV = DIV;
+    u8 timer_enabled = state.TAC & 0b100; 
+    u16 prev_DIV = state.DIV;
 
-    DIV++; // DIV is ticked every time (every "T-cycle")
+    state.DIV++; // DIV is ticked every time (every "T-cycle")
 
     // Detect a "falling edge": if the bit goes from 1 to 0
-    bool timer_update = (prev_DIV & bit_pos) && !(DIV & bit_pos);
+    bool timer_update = (prev_DIV & bit_pos) && !(state.DIV & bit_pos);
 
     if (timer_enabled && timer_update) {
-        TIMA++;
+        state.TIMA++;
 
-        if (TIMA == 0) { 
+        if (state.TIMA == 0) { 
             
             // Reset TIMA if it overflows
-            TIMA = TMA;
+            state.TIMA = state.TMA;
 
             return true; // Request a timer interrupt
         }
@@ -42,16 +42,16 @@ bool Timer::tick() {
 u8 Timer::read(u16 addr) {
     switch (addr) {
         case 0xFF04:
-            return DIV >> 8; // only the upper byte of DIV is seen
+            return state.DIV >> 8; // only the upper byte of DIV is seen
             break;
         case 0xFF05:
-            return TIMA;
+            return state.TIMA;
             break;
         case 0xFF06:
-            return TMA;
+            return state.TMA;
             break;
         case 0xFF07:
-            return TAC;
+            return state.TAC;
             break;
     }
 
@@ -61,16 +61,16 @@ u8 Timer::read(u16 addr) {
 void Timer::write(u16 addr, u8 val) {
     switch (addr) {
         case 0xFF04:
-            DIV = 0; // any write to DIV resets it
+            state.DIV = 0; // any write to DIV resets it
             break;
         case 0xFF05:
-            TIMA = val;
+            state.TIMA = val;
             break;
         case 0xFF06:
-            TMA = val;
+            state.TMA = val;
             break;
         case 0xFF07:
-            TAC = val;
+            state.TAC = val;
             break;
     }
 }
\ No newline at end of file
@@ -2,16 +2,14 @@
 #define TIMER_H
 
 #include "common.h"
+#include "machine_state.h"
 
 class Timer {
     private:
-        // https://gbdev.io/pandocs/Power_Up_Sequence.html#hardware-registers
-        u16 DIV = 0xAB00;
-        u8 TIMA = 0x00;
-        u8 TMA = 0x00;
-        u8 TAC = 0xF8;
+        // DIV, TIMA, TMA and TAC live in the machine state
+        MachineState &state;
     public:
-        Timer();
+        Timer(MachineState &state_);
         ~Timer();
         bool tick();
         u8 read(u16 addr);
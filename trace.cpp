@@ -0,0 +1,81 @@
+#include "trace.h"
+#include <mutex>
+#include <vector>
+#include <memory>
+
+const u64 ring_size = 1 << 20; // Events per thread, about two minutes of frames
+
+std::atomic<bool> trace_on{false};
+
+// One per thread that ever recorded. Only its own thread writes to it;
+// head is published with release so trace_write sees whole events.
+struct TraceRing {
+    std::unique_ptr<TraceEvent[]> events{new TraceEvent[ring_size]};
+    std::atomic<u64> head{0}; // Events ever recorded
+    int tid;
+};
+
+// Rings outlive their threads so they can still be written out
+std::mutex rings_lock;
+std::vector<std::shared_ptr<TraceRing>> rings;
+std::chrono::steady_clock::time_point trace_epoch;
+
+TraceRing *thread_ring() {
+    thread_local std::shared_ptr<TraceRing> ring;
+    if (!ring) {
+        ring = std::make_shared<TraceRing>();
+        std::lock_guard<std::mutex> guard(rings_lock);
+        ring->tid = rings.size() + 1;
+        rings.push_back(ring);
+    }
+    return ring.get();
+}
+
+void trace_start() {
+    trace_epoch = std::chrono::steady_clock::now();
+    trace_on.store(true);
+}
+
+void trace_stop() {
+    trace_on.store(false);
+}
+
+u64 trace_now() {
+    // 0 means "not started" in TraceZone, so the clock starts at 1
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - trace_epoch).count() + 1;
+}
+
+void trace_record(const char *name, u64 start, u64 end) {
+    TraceRing *ring = thread_ring();
+    u64 head = ring->head.load(std::memory_order_relaxed);
+    ring->events[head % ring_size] = {name, start, end - start};
+    ring->head.store(head + 1, std::memory_order_release);
+}
+
+bool trace_write(const char *path) {
+    std::ofstream ofs;
+    ofs.open(path);
+    if (ofs.fail()) {
+        std::cout << "Trace file failed to be created\n";
+        return false;
+    }
+
+    // Complete ("X") events in microseconds, one thread per ring
+    ofs << "{\"displayTimeUnit\": \"ms\", \"traceEvents\": [\n";
+    bool first = true;
+    std::lock_guard<std::mutex> guard(rings_lock);
+    for (const auto &ring : rings) {
+        u64 head = ring->head.load(std::memory_order_acquire);
+        u64 begin = head > ring_size ? head - ring_size : 0;
+        for (u64 i = begin; i < head; i++) {
+            const TraceEvent &e = ring->events[i % ring_size];
+            ofs << (first ? "" : ",\n") << std::fixed << std::setprecision(3)
+                << "{\"name\": \"" << e.name << "\", \"ph\": \"X\", \"pid\": 1, \"tid\": " << ring->tid
+                << ", \"ts\": " << (e.start - 1) / 1000.0 << ", \"dur\": " << e.duration / 1000.0 << "}";
+            first = false;
+        }
+    }
+    ofs << "\n]}\n";
+    ofs.close();
+    return !ofs.fail();
+}
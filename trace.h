@@ -0,0 +1,47 @@
+#ifndef TRACE_H
+#define TRACE_H
+
+#include "common.h"
+#include <atomic>
+#include <chrono>
+
+// Timeline of what the host spent each frame on, for chrome://tracing
+// or Perfetto.
+//
+// TRACE_ZONE("name") times the rest of the enclosing scope. Each thread
+// records into its own ring, so zones never lock or share cache lines;
+// once a ring fills up the oldest zones are overwritten, keeping the
+// latest stretch of the run. With tracing off a zone is one relaxed load.
+// Names must be string literals (only the pointer is kept).
+struct TraceEvent {
+    const char *name;
+    u64 start; // ns since tracing started
+    u64 duration;
+};
+
+extern std::atomic<bool> trace_on;
+
+void trace_start();
+void trace_stop();
+void trace_record(const char *name, u64 start, u64 end);
+u64 trace_now();
+bool trace_write(const char *path); // Chrome trace JSON of every thread's ring
+
+class TraceZone {
+    private:
+        const char *name;
+        u64 start = 0;
+    public:
+        TraceZone(const char *name_) : name(name_) {
+            if (trace_on.load(std::memory_order_relaxed)) start = trace_now();
+        }
+        ~TraceZone() {
+            if (start && trace_on.load(std::memory_order_relaxed)) trace_record(name, start, trace_now());
+        }
+};
+
+#define TRACE_CONCAT_(a, b) a##b
+#define TRACE_CONCAT(a, b) TRACE_CONCAT_(a, b)
+#define TRACE_ZONE(name) TraceZone TRACE_CONCAT(trace_zone_, __LINE__)(name)
+
+#endif
@@ -0,0 +1,42 @@
+#include "exec_trace.h"
+
+// gb-trace: prints an execution trace (gb-emu --exec-trace) as text.
+//
+//     gb-trace [-x] [-n count] trace.bin
+//
+// Lines follow the gameboy-doctor log format, one per instruction:
+//     A:01 F:B0 B:00 C:13 D:00 E:D8 H:01 L:4D SP:FFFE PC:0100 PCMEM:00,C3,13,02
+// -x adds the ROM bank and cycle count, which gameboy-doctor doesn't
+// expect. Note that its reference logs assume LY always reads 0x90.
+
+int main(int argc, char** argv) {
+    bool extended = false;
+    u64 count = ~0ull;
+    int opt;
+    while ((opt = getopt(argc, argv, "xn:")) != -1) {
+        switch (opt) {
+            case 'x': extended = true; break;
+            case 'n': count = strtoull(optarg, nullptr, 10); break;
+        }
+    }
+    if (optind >= argc) {
+        std::cout << "usage: gb-trace [-x] [-n count] trace.bin\n";
+        return -1;
+    }
+
+    ExecTraceReader reader;
+    if (!reader.open(argv[optind])) return -1;
+
+    // One buffer for the whole line; this prints millions of them
+    ExecRecord r;
+    char line[128];
+    for (u64 i = 0; i < count && reader.next(r); i++) {
+        int n = snprintf(line, sizeof(line),
+            "A:%02X F:%02X B:%02X C:%02X D:%02X E:%02X H:%02X L:%02X SP:%04X PC:%04X PCMEM:%02X,%02X,%02X,%02X",
+            r.a, r.f, r.b, r.c, r.d, r.e, r.h, r.l, r.sp, r.pc, r.pcmem[0], r.pcmem[1], r.pcmem[2], r.pcmem[3]);
+        if (extended) n += snprintf(line + n, sizeof(line) - n, " BANK:%02X CY:%llu", r.bank, (unsigned long long)r.cycles);
+        line[n++] = '\n';
+        fwrite(line, 1, n, stdout);
+    }
+    return 0;
+}
@@ -0,0 +1,100 @@
+#include "vec_env.h"
+
+VecEnv::VecEnv(int count, int threads) : pool(threads) {
+    for (int i = 0; i < count; i++) envs.emplace_back(new Emulator());
+}
+
+VecEnv::~VecEnv() {}
+
+bool VecEnv::load_rom(const char *path) {
+    // The ROM is mapped once and shared by every instance
+    for (int i = 0; i < size(); i++) {
+        if (!envs[i]->load_rom(path)) return false;
+    }
+    set_reset_point();
+    return true;
+}
+
+bool VecEnv::load_rom(const u8 *data, u32 rom_size) {
+    for (int i = 0; i < size(); i++) {
+        if (!envs[i]->load_rom(data, rom_size)) return false;
+    }
+    set_reset_point();
+    return true;
+}
+
+void VecEnv::set_observation(const ObsSpec &spec_) {
+    spec = spec_;
+    spec.width = std::max(1, std::min(spec.width, 160));
+    spec.height = std::max(1, std::min(spec.height, 144));
+}
+
+void VecEnv::set_ram_watch(const u16 *addrs, int count) {
+    watch.assign(addrs, addrs + count);
+}
+
+void VecEnv::set_reset_point() {
+    // Whole snapshots, so cartridge RAM doesn't carry over between episodes
+    for (int i = 0; i < size(); i++) envs[i]->set_reset_point();
+}
+
+void VecEnv::observe(int i, u8 *obs, u8 *ram) {
+    if (obs) envs[i]->observe(spec, obs + (size_t)i * obs_size());
+    if (ram) {
+        u8 *dst = ram + (size_t)i * ram_size();
+        for (size_t k = 0; k < watch.size(); k++) dst[k] = envs[i]->peek(watch[k]);
+    }
+}
+
+bool VecEnv::for_each(std::function<bool(int)> fn) {
+    // One contiguous slice per worker keeps task overhead off the hot path
+    std::atomic<bool> ok{true};
+    int n = size();
+    int slices = std::min(n, pool.size());
+    for (int s = 0; s < slices; s++) {
+        int begin = n * s / slices;
+        int end = n * (s + 1) / slices;
+        pool.submit([&fn, &ok, begin, end](int) {
+            for (int i = begin; i < end; i++) {
+                if (!fn(i)) ok = false;
+            }
+        });
+    }
+    pool.wait();
+    return ok;
+}
+
+bool VecEnv::reset(u8 *obs, u8 *ram) {
+    return for_each([&](int i) { return reset_one(i, obs, ram); });
+}
+
+bool VecEnv::reset_one(int i, u8 *obs, u8 *ram) {
+    envs[i]->reset();
+    envs[i]->set_joypad(0);
+    observe(i, obs, ram);
+    return true;
+}
+
+bool VecEnv::step(const u8 *actions, int frameskip, u8 *obs, u8 *ram) {
+    return for_each([&](int i) {
+        // Hold the buttons for the whole skip, observe the last frame
+        envs[i]->set_joypad(actions[i]);
+        for (int f = 0; f < std::max(1, frameskip); f++) {
+            if (!envs[i]->run_frame()) return false;
+        }
+        observe(i, obs, ram);
+        return true;
+    });
+}
+
+int VecEnv::size() {
+    return envs.size();
+}
+
+int VecEnv::obs_size() {
+    return spec.size();
+}
+
+int VecEnv::ram_size() {
+    return watch.size();
+}
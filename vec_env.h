@@ -0,0 +1,43 @@
+#ifndef VEC_ENV_H
+#define VEC_ENV_H
+
+#include "common.h"
+#include "emulator.h"
+#include "thread_pool.h"
+#include <memory>
+#include <vector>
+
+// A batch of emulators stepped together, for reinforcement learning.
+//
+// One call steps every instance in parallel and writes observations for
+// all of them into contiguous caller-owned buffers: frames as
+// obs[count][height][width][channels] and watched memory as
+// ram[count][watch count]. Nothing is staged in between.
+class VecEnv {
+    private:
+        std::vector<std::unique_ptr<Emulator>> envs;
+        ThreadPool pool;
+        ObsSpec spec;
+        std::vector<u16> watch;              // Addresses copied into ram
+
+        void observe(int i, u8 *obs, u8 *ram);
+        bool for_each(std::function<bool(int)> fn);
+    public:
+        VecEnv(int count, int threads = 0);
+        ~VecEnv();
+        bool load_rom(const char *path);
+        bool load_rom(const u8 *data, u32 size);
+        void set_observation(const ObsSpec &spec_);
+        void set_ram_watch(const u16 *addrs, int count);
+        void set_reset_point(); // Episodes start from where each instance is now
+
+        bool reset(u8 *obs, u8 *ram);
+        bool reset_one(int i, u8 *obs, u8 *ram);
+        bool step(const u8 *actions, int frameskip, u8 *obs, u8 *ram);
+
+        int size();
+        int obs_size();   // Bytes per instance in obs
+        int ram_size();   // Bytes per instance in ram
+};
+
+#endif